@@ -0,0 +1,34 @@
+#include "AddressFilter.h"
+
+AddressFilter::AddressFilter(const std::set<IPNetwork> &allow, const std::set<IPNetwork> &deny):
+    allowCount(allow.size()),
+    denyCount(deny.size())
+{
+    for(auto const &prefix : allow)
+        table.Insert(prefix,true);
+    for(auto const &prefix : deny)
+        table.Insert(prefix,false);
+}
+
+AddressFilterResult AddressFilter::Match(const IPAddress &ip) const
+{
+    auto entry=table.Lookup(ip);
+    if(entry==nullptr)
+        return ADDR_NO_MATCH;
+    return entry->second?ADDR_ALLOWED:ADDR_DENIED;
+}
+
+bool AddressFilter::IsAccepted(const AddressFilterResult result) const
+{
+    return result==ADDR_ALLOWED||(result==ADDR_NO_MATCH&&allowCount==0);
+}
+
+size_t AddressFilter::AllowCount() const
+{
+    return allowCount;
+}
+
+size_t AddressFilter::DenyCount() const
+{
+    return denyCount;
+}
@@ -0,0 +1,35 @@
+#ifndef ADDRESSFILTER_H
+#define ADDRESSFILTER_H
+
+#include "IPAddress.h"
+#include "IPNetwork.h"
+#include "LPMTable.h"
+
+#include <set>
+
+enum AddressFilterResult
+{
+    ADDR_NO_MATCH,
+    ADDR_ALLOWED,
+    ADDR_DENIED,
+};
+
+//allow and deny lists of destination prefixes compiled into the single longest-prefix-match table.
+//the most specific prefix wins, deny wins for the prefix present in both lists.
+//instance is immutable after construction and may be shared between threads.
+class AddressFilter
+{
+    private:
+        LPMTable<bool> table; //true - allow, false - deny
+        const size_t allowCount;
+        const size_t denyCount;
+    public:
+        AddressFilter(const std::set<IPNetwork> &allow, const std::set<IPNetwork> &deny);
+        AddressFilterResult Match(const IPAddress &ip) const;
+        //address without matching prefix is accepted only when allow list is empty
+        bool IsAccepted(const AddressFilterResult result) const;
+        size_t AllowCount() const;
+        size_t DenyCount() const;
+};
+
+#endif // ADDRESSFILTER_H
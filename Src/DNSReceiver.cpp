@@ -1,27 +1,180 @@
 #include "DNSReceiver.h"
 #include "dnsmessage.pb.h"
+#include "IoUring.h"
 
 #include <thread>
 #include <chrono>
 #include <cstring>
 #include <cerrno>
 #include <string>
+#include <iterator>
 
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/timerfd.h>
+#include <pthread.h>
+#include <sched.h>
+
+//maximum number of cached filter results, cache is dropped when full
+#define MATCH_CACHE_SIZE 65536
+//maximum number of addresses in deduplication cache per profile, expired entries are removed when full
+#define DEDUP_CACHE_SIZE 262144
+//maximum number of reads from single client per poll round or reactor event
+#define CLIENT_READS_PER_EVENT 64
+
+#ifdef HAVE_IO_URING
+//io_uring queue size and provided receive buffers
+#define URING_ENTRIES 256
+#define URING_BUF_COUNT 256
+#define URING_BUF_SIZE 16384
+#define URING_BUF_GROUP 1
+//request type stored in the upper half of io_uring user_data, descriptor in the lower half
+#define URING_ACCEPT 1ULL
+#define URING_RECV 2ULL
+#define URING_WAKEUP 3ULL
+#endif
 
 class ShutdownMessage: public IShutdownMessage { public: ShutdownMessage(int _ec):IShutdownMessage(_ec){} };
-class RouteRequestMessage: public IRouteRequestMessage { public: RouteRequestMessage(const IPAddress &_ip, const unsigned int _ttl):IRouteRequestMessage(_ip,_ttl){} };
+class RouteRequestMessage: public IRouteRequestMessage { public: RouteRequestMessage(const std::vector<RouteRequest> &_requests):IRouteRequestMessage(_requests){} };
 
-DNSReceiver::DNSReceiver(ILogger &_logger, IMessageSender &_sender, const timeval _timeout, const IPAddress _listenAddr, const int _port):
+DNSReceiver::DNSReceiver(ILogger &_logger, IMessageSender &_sender, const std::vector<IMessageSender*> &_profileSenders, const std::vector<const IRouteState*> &_routeStates, const timeval _timeout, const IPAddress _listenAddr, const int _port, const unsigned int _dedupGranularity, const bool _useUring, const int _cpu):
     logger(_logger),
     sender(_sender),
+    profileSenders(_profileSenders),
+    routeStates(_routeStates),
     timeout(_timeout),
     listenAddr(_listenAddr),
-    port(_port)
+    port(_port),
+    dedupGranularity(_dedupGranularity),
+    useUring(_useUring),
+    cpu(_cpu),
+    dedupCache(_profileSenders.size()),
+    requestBatches(_profileSenders.size())
 {
     shutdownPending.store(false);
+    recordsAccepted.store(0);
+    recordsFiltered.store(0);
+    addrAllowHits.store(0);
+    addrDenyHits.store(0);
+    addrNotAllowed.store(0);
+    requestsSent.store(0);
+    requestsSuppressed.store(0);
+    messagesDecoded.store(0);
+    uringEnters.store(0);
+    uringCompletions.store(0);
+}
+
+void DNSReceiver::SetDomainFilter(const std::shared_ptr<const DomainFilter> &filter)
+{
+    std::atomic_store(&domainFilter,filter);
+}
+
+void DNSReceiver::SetAddressFilter(const std::shared_ptr<const AddressFilter> &filter)
+{
+    std::atomic_store(&addressFilter,filter);
+}
+
+void DNSReceiver::LogStats()
+{
+    logger.Info()<<"Records passed domain filter: "<<recordsAccepted.load()<<"; filtered out: "<<recordsFiltered.load()<<std::endl;
+    logger.Info()<<"Address filter hits: allow list="<<addrAllowHits.load()<<"; deny list="<<addrDenyHits.load()<<"; not in allow list="<<addrNotAllowed.load()<<std::endl;
+    auto sent=requestsSent.load();
+    auto suppressed=requestsSuppressed.load();
+    logger.Info()<<"Route requests sent: "<<sent<<"; duplicates suppressed: "<<suppressed<<" ("<<(sent+suppressed>0?suppressed*100/(sent+suppressed):0)<<"%)"<<std::endl;
+    auto messages=messagesDecoded.load();
+    auto enters=uringEnters.load();
+    logger.Info()<<"Messages decoded: "<<messages<<std::endl;
+    if(enters>0)
+        logger.Info()<<"io_uring: enter calls="<<enters<<"; completions="<<uringCompletions.load()<<"; messages per enter call="<<static_cast<double>(messages)/static_cast<double>(enters)<<std::endl;
+}
+
+static uint64_t GetTimeSec()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//request is duplicate if it would not move expiration time of the route by at least dedupGranularity seconds.
+//first occurrence of the record for the question (udr flag) is never suppressed, neither is the request
+//sent after route for the address may have been removed (expired early, evicted, refused or covering route lost)
+bool DNSReceiver::IsDuplicate(const size_t profile, const IPAddress &ip, const unsigned int ttl, const bool udr)
+{
+    if(dedupGranularity<1)
+        return false;
+    auto now=GetTimeSec();
+    auto expiry=now+ttl;
+    auto generation=routeStates[profile]->RemovalGeneration(ip);
+    auto &cache=dedupCache[profile];
+    auto it=cache.find(ip);
+    if(it!=cache.end())
+    {
+        if(!udr && generation==it->second.generation && expiry<it->second.expiry+dedupGranularity)
+        {
+            requestsSuppressed++;
+            return true;
+        }
+        it->second=DedupRecord{expiry,generation};
+        return false;
+    }
+    if(cache.size()>=DEDUP_CACHE_SIZE)
+    {
+        for(auto cIt=cache.begin();cIt!=cache.end();)
+            cIt=cIt->second.expiry<=now?cache.erase(cIt):std::next(cIt);
+        if(cache.size()>=DEDUP_CACHE_SIZE)
+            cache.clear();
+    }
+    cache.emplace(ip,DedupRecord{expiry,generation});
+    return false;
+}
+
+bool DNSReceiver::CheckAddress(const IPAddress &ip)
+{
+    auto filter=std::atomic_load(&addressFilter);
+    if(!filter)
+        return true;
+    auto result=filter->Match(ip);
+    if(result==ADDR_ALLOWED)
+        addrAllowHits++;
+    else if(result==ADDR_DENIED)
+        addrDenyHits++;
+    else if(!filter->IsAccepted(result))
+        addrNotAllowed++;
+    return filter->IsAccepted(result);
+}
+
+int DNSReceiver::MatchCached(const std::string &name)
+{
+    auto it=matchCache.find(name);
+    if(it!=matchCache.end())
+        return it->second;
+    if(matchCache.size()>=MATCH_CACHE_SIZE)
+        matchCache.clear();
+    auto result=cacheFilter->Match(name);
+    matchCache.emplace(name,result);
+    return result;
+}
+
+//record is accepted if query name or record name is included, and none of them is excluded.
+//profile matched by query name takes precedence. returns profile index or DomainFilter::NoMatch
+int DNSReceiver::MatchProfile(const std::string &qName, const std::string &rrName)
+{
+    auto filter=std::atomic_load(&domainFilter);
+    if(filter!=cacheFilter)
+    {
+        matchCache.clear();
+        cacheFilter=filter;
+    }
+    if(!cacheFilter)
+        return 0;
+    auto qResult=qName.empty()?DomainFilter::NoMatch:MatchCached(qName);
+    auto rrResult=rrName.empty()?DomainFilter::NoMatch:MatchCached(rrName);
+    if(qResult==DomainFilter::Exclude||rrResult==DomainFilter::Exclude)
+        return DomainFilter::NoMatch;
+    if(qResult>=0)
+        return qResult;
+    return rrResult>=0?rrResult:DomainFilter::NoMatch;
 }
 
 static uint16_t DecodeHeader(const void * const data)
@@ -48,234 +201,590 @@ void DNSReceiver::OnShutdown()
     shutdownPending.store(true);
 }
 
-void DNSReceiver::Worker()
+//decode single dnsdist message and send route requests for accepted records, one batch per profile
+void DNSReceiver::ProcessPayload(const unsigned char * const data, const size_t dataSize)
+{
+    PBDNSMessage message;
+    if(!message.ParseFromArray(data,static_cast<int>(dataSize)))
+    {
+        logger.Warning()<<"Failed to decode payload of size "<<dataSize<<std::endl;
+        return;
+    }
+    if(!message.has_response() || message.response().rrs_size()<1)
+    {
+        logger.Warning()<<"No valid response or dns resource records provided in dnsdist message"<<std::endl;
+        return;
+    }
+    messagesDecoded++;
+    auto qName=message.has_question()&&message.question().has_qname()?message.question().qname():std::string();
+    //parse dns resource records
+    for(auto rIdx=0;rIdx<message.response().rrs_size();++rIdx)
+    {
+        auto record=message.response().rrs(rIdx);
+        auto profile=MatchProfile(qName,record.has_name()?record.name():std::string());
+        if(profile<0||static_cast<size_t>(profile)>=profileSenders.size())
+        {
+            recordsFiltered++;
+            continue;
+        }
+        recordsAccepted++;
+        std::string name=record.has_name()?record.name():"<NO NAME>";
+        auto type=record.has_type()?record.type():0;
+        auto ttl=record.has_ttl()?record.ttl():0;
+        auto rdata=record.has_rdata()?record.rdata():std::string();
+        if(rdata.empty()||(type!=1&&type!=28))
+            logger.Warning()<<"Unsupported dns resource record provided -> name="<<name<<",type="<<type<<",ttl="<<ttl<<",rdata len="<<rdata.length()<<std::endl;
+        else
+        {
+            IPAddress ip(rdata.data(),rdata.length());
+            if(!ip.isValid)
+                logger.Warning()<<"Invalid ip address decoded for response -> name="<<name<<",type="<<type<<",ttl="<<ttl<<",rdata len="<<rdata.length()<<std::endl;
+            else if(!CheckAddress(ip))
+                continue;
+            else if(!IsDuplicate(static_cast<size_t>(profile),ip,ttl,record.has_udr()&&record.udr()))
+            {
+                logger.Info()<<"Valid response decoded -> name="<<name<<",ip="<<ip<<",type="<<type<<",ttl="<<ttl<<std::endl;
+                requestsSent++;
+                requestBatches[static_cast<size_t>(profile)].emplace_back(ip,ttl);
+            }
+        }
+    }
+    for(size_t p=0;p<requestBatches.size();++p)
+    {
+        if(requestBatches[p].empty())
+            continue;
+        profileSenders[p]->SendMessage(this,RouteRequestMessage(requestBatches[p]));
+        requestBatches[p].clear();
+    }
+}
+
+//perform single read from client socket, decode and process message when it is complete
+DNSReceiver::ClientReadResult DNSReceiver::ReadClient(const int fd, ClientStream &stream)
+{
+    auto dataRead=read(fd,reinterpret_cast<void*>(stream.data+stream.dataSize-stream.dataLeft),stream.dataLeft);
+    if(dataRead==0)
+    {
+        logger.Info()<<"Client disconnected"<<std::endl;
+        return CLIENT_CLOSED; //connection closed
+    }
+    if(dataRead<0)
+    {
+        if(errno==EAGAIN||errno==EINTR)
+            return CLIENT_WOULDBLOCK;
+        logger.Warning()<<"Error reading data from client: "<<strerror(errno)<<std::endl;
+        return CLIENT_CLOSED;
+    }
+    stream.dataLeft-=static_cast<size_t>(dataRead);
+    if(stream.dataLeft==0)
+        CompleteFrame(stream);
+    return CLIENT_DATA;
+}
+
+//header or payload is fully received to the stream buffer, process it and setup reading of the next part
+void DNSReceiver::CompleteFrame(ClientStream &stream)
+{
+    if(stream.headerPending)
+    {//decore header, setup read of data-payload
+        stream.dataSize=DecodeHeader(stream.data);
+        if(stream.dataSize<1)
+            stream.dataSize=2; //zero sized payload, setup read for another header
+        else
+            stream.headerPending=false;
+        stream.dataLeft=stream.dataSize;
+    }
+    else
+    {//decode payload, setup read of next data-header
+        ProcessPayload(stream.data,stream.dataSize);
+        stream.headerPending=true;
+        stream.dataSize=stream.dataLeft=2;
+    }
+}
+
+//decode received chunk of data: complete messages are parsed in place, only incomplete ones are copied to the stream buffer
+void DNSReceiver::ConsumeData(ClientStream &stream, const unsigned char *data, size_t len)
+{
+    while(len>0)
+    {
+        if(stream.headerPending&&stream.dataLeft==2&&len>=2)
+        {
+            size_t size=DecodeHeader(data);
+            if(len>=size+2)
+            {
+                if(size>0)
+                    ProcessPayload(data+2,size);
+                data+=size+2;
+                len-=size+2;
+                continue;
+            }
+        }
+        auto chunk=len<stream.dataLeft?len:stream.dataLeft;
+        std::memcpy(stream.data+stream.dataSize-stream.dataLeft,data,chunk);
+        data+=chunk;
+        len-=chunk;
+        stream.dataLeft-=chunk;
+        if(stream.dataLeft==0)
+            CompleteFrame(stream);
+    }
+}
+
+//create listen socket and tune its options, returns -1 on error
+int DNSReceiver::CreateListenSocket()
 {
     if(!listenAddr.isValid)
     {
         HandleError("Listen IP address is invalid");
-        return;
+        return -1;
     }
 
     if(port<1||port>65535)
     {
         HandleError("Port number is invalid");
-        return;
+        return -1;
+    }
+
+    auto lSockFd=socket(listenAddr.isV6?AF_INET6:AF_INET,SOCK_STREAM|SOCK_CLOEXEC,0);
+    if(lSockFd==-1)
+    {
+        HandleError(errno,"Failed to create listen socket: ");
+        return -1;
+    }
+
+    //tune some some options
+    int sockReuseAddrEnabled=1;
+    if (setsockopt(lSockFd, SOL_SOCKET, SO_REUSEADDR, &sockReuseAddrEnabled, sizeof(int))!=0)
+    {
+        HandleError(errno,"Failed to set SO_REUSEADDR option: ");
+        close(lSockFd);
+        return -1;
+    }
+#ifdef SO_REUSEPORT
+    int sockReusePortEnabled=1;
+    if (setsockopt(lSockFd, SOL_SOCKET, SO_REUSEPORT, &sockReusePortEnabled, sizeof(int))!=0)
+    {
+        HandleError(errno,"Failed to set SO_REUSEPORT option: ");
+        close(lSockFd);
+        return -1;
+    }
+#endif
+
+    linger lLinger={1,0};
+    if (setsockopt(lSockFd, SOL_SOCKET, SO_LINGER, &lLinger, sizeof(linger))!=0)
+    {
+        HandleError(errno,"Failed to set SO_LINGER option: ");
+        close(lSockFd);
+        return -1;
     }
+    return lSockFd;
+}
 
-    auto dTimeout=std::chrono::seconds(timeout.tv_sec)+std::chrono::microseconds(timeout.tv_usec);
+//bind listen socket to configured address, returns false if bind should be retried later
+bool DNSReceiver::BindListenSocket(const int lSockFd, bool &bindFailWarned)
+{
+    sockaddr_in ipv4Addr = {};
+    sockaddr_in6 ipv6Addr = {};
+    sockaddr *target;
+    socklen_t len;
+    if(listenAddr.isV6)
+    {
+        ipv6Addr.sin6_family=AF_INET6;
+        ipv6Addr.sin6_port=htons(static_cast<uint16_t>(port));
+        listenAddr.ToSA(&ipv6Addr);
+        target=reinterpret_cast<sockaddr*>(&ipv6Addr);
+        len=sizeof(sockaddr_in6);
+    }
+    else
+    {
+        ipv4Addr.sin_family=AF_INET;
+        ipv4Addr.sin_port=htons(static_cast<uint16_t>(port));
+        listenAddr.ToSA(&ipv4Addr);
+        target=reinterpret_cast<sockaddr*>(&ipv4Addr);
+        len=sizeof(sockaddr_in);
+    }
 
-    while(!shutdownPending.load())
+    if (bind(lSockFd,target,len)!=0)
     {
-        //create listen socket
-        auto lSockFd=socket(listenAddr.isV6?AF_INET6:AF_INET,SOCK_STREAM,0);
-        if(lSockFd==-1)
+        if(!bindFailWarned)
         {
-            HandleError(errno,"Failed to create listen socket: ");
-            return;
+            bindFailWarned=true;
+            logger.Warning()<<"Failed to bind listen socket: "<<strerror(errno)<<std::endl;
         }
+        return false;
+    }
+    return true;
+}
 
-        //tune some some options
-        int sockReuseAddrEnabled=1;
-        if (setsockopt(lSockFd, SOL_SOCKET, SO_REUSEADDR, &sockReuseAddrEnabled, sizeof(int))!=0)
-        {
-            HandleError(errno,"Failed to set SO_REUSEADDR option: ");
+//pin worker thread to configured cpu
+void DNSReceiver::PinWorker()
+{
+    if(cpu<0)
+        return;
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu,&cpuSet);
+    auto error=pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&cpuSet);
+    if(error!=0)
+        logger.Warning()<<"Failed to pin worker thread to cpu "<<cpu<<": "<<strerror(error)<<std::endl;
+    else
+        logger.Info()<<"Worker thread pinned to cpu "<<cpu<<std::endl;
+}
+
+//accept pending connection from non-blocking listen socket and setup new client stream, returns client descriptor or -1
+int DNSReceiver::AcceptClient()
+{
+    auto cSockFd=accept4(listenFd,nullptr,nullptr,SOCK_NONBLOCK|SOCK_CLOEXEC);
+    if(cSockFd<0)
+    {
+        if(errno!=EAGAIN&&errno!=EINTR)
+            logger.Warning()<<"Failed to accept connection: "<<strerror(errno)<<std::endl;
+        return -1;
+    }
+    linger cLinger={1,0};
+    if (setsockopt(cSockFd, SOL_SOCKET, SO_LINGER, &cLinger, sizeof(linger))!=0)
+        logger.Warning()<<"Failed to set SO_LINGER option to client socket: "<<strerror(errno)<<std::endl;
+    clients[cSockFd]=std::unique_ptr<ClientStream>(new ClientStream());
+    logger.Info()<<"Client connected"<<std::endl;
+    return cSockFd;
+}
+
+//read available data from the client, reads are limited so busy client will not delay others
+void DNSReceiver::ServeClient(const int fd)
+{
+    auto it=clients.find(fd);
+    if(it==clients.end())
+        return;
+    for(auto i=0;i<CLIENT_READS_PER_EVENT;++i)
+    {
+        auto result=ReadClient(fd,*(it->second));
+        if(result==CLIENT_WOULDBLOCK)
             return;
-        }
-#ifdef SO_REUSEPORT
-        int sockReusePortEnabled=1;
-        if (setsockopt(lSockFd, SOL_SOCKET, SO_REUSEPORT, &sockReusePortEnabled, sizeof(int))!=0)
+        if(result==CLIENT_CLOSED)
         {
-            HandleError(errno,"Failed to set SO_REUSEPORT option: ");
+            CloseClient(fd);
             return;
         }
-#endif
+    }
+}
 
-        linger lLinger={1,0};
-        if (setsockopt(lSockFd, SOL_SOCKET, SO_LINGER, &lLinger, sizeof(linger))!=0)
-        {
-            HandleError(errno,"Failed to set SO_LINGER option: ");
-            return;
-        }
+void DNSReceiver::CloseClient(const int fd)
+{
+    logger.Info()<<"Closing client connection"<<std::endl;
+    if(reactor!=nullptr)
+        reactor->Remove(fd);
+    clients.erase(fd);
+    if(close(fd)!=0)
+        logger.Warning()<<"Failed to close client socket: "<<strerror(errno)<<std::endl;
+}
 
-        bool bindFailWarned=false;
-        bool bindComplete=false;
-        while(!bindComplete && !shutdownPending.load())
-        {
-            //check for shutdown ?
+void DNSReceiver::CloseClients()
+{
+    std::vector<int> fds;
+    for(auto const &client : clients)
+        fds.push_back(client.first);
+    for(auto fd : fds)
+        CloseClient(fd);
+}
 
-            sockaddr_in ipv4Addr = {};
-            sockaddr_in6 ipv6Addr = {};
-            sockaddr *target;
-            socklen_t len;
-            if(listenAddr.isV6)
-            {
-                ipv6Addr.sin6_family=AF_INET6;
-                ipv6Addr.sin6_port=htons(static_cast<uint16_t>(port));
-                listenAddr.ToSA(&ipv6Addr);
-                target=reinterpret_cast<sockaddr*>(&ipv6Addr);
-                len=sizeof(sockaddr_in6);
-            }
-            else
+//bind listen socket, retrying until success or shutdown request. returns false on shutdown or error
+bool DNSReceiver::WaitListen(const int lSockFd)
+{
+    auto retryMs=static_cast<int>(timeout.tv_sec*1000+timeout.tv_usec/1000);
+    bool bindFailWarned=false;
+    while(!BindListenSocket(lSockFd,bindFailWarned))
+    {
+        //wait before next bind attempt, shutdown request will interrupt waiting
+        pollfd wFd={GetWakeupFd(),POLLIN,0};
+        poll(&wFd,1,retryMs);
+        if(shutdownPending.load())
+            return false;
+    }
+    if(listen(lSockFd,SOMAXCONN)!=0)
+    {
+        HandleError(errno,"Failed to setup listen socket: ");
+        return false;
+    }
+    return true;
+}
+
+void DNSReceiver::Worker()
+{
+    PinWorker();
+#ifdef HAVE_IO_URING
+    if(useUring&&UringWorker())
+        return;
+#else
+    if(useUring)
+        logger.Warning()<<"io_uring support is not compiled in, using regular receive loop"<<std::endl;
+#endif
+    listenFd=CreateListenSocket();
+    if(listenFd==-1)
+        return;
+    if(fcntl(listenFd,F_SETFL,fcntl(listenFd,F_GETFL)|O_NONBLOCK)!=0)
+        HandleError(errno,"Failed to set non-blocking mode for listen socket: ");
+    else if(WaitListen(listenFd))
+    {
+        logger.Info()<<"Listening for incoming connections"<<std::endl;
+        std::vector<pollfd> fds;
+        while(!shutdownPending.load())
+        {
+            //wait for new connection, data from any client or shutdown request
+            fds.clear();
+            fds.push_back({GetWakeupFd(),POLLIN,0});
+            fds.push_back({listenFd,POLLIN,0});
+            for(auto const &client : clients)
+                fds.push_back({client.first,POLLIN,0});
+            if(poll(fds.data(),fds.size(),-1)<0)
             {
-                ipv4Addr.sin_family=AF_INET;
-                ipv4Addr.sin_port=htons(static_cast<uint16_t>(port));
-                listenAddr.ToSA(&ipv4Addr);
-                target=reinterpret_cast<sockaddr*>(&ipv4Addr);
-                len=sizeof(sockaddr_in);
+                auto error=errno;
+                if(error==EINTR)//interrupted by signal
+                    continue;
+                HandleError(error,"Error awaiting data from clients: ");
+                break;
             }
+            //every ready client gets its share of reads before new connections are accepted
+            for(size_t i=2;i<fds.size();++i)
+                if(fds[i].revents!=0)
+                    ServeClient(fds[i].fd);
+            if(fds[1].revents!=0)
+                AcceptClient();
+        }
+    }
+    CloseClients();
+    if(close(listenFd)!=0)
+        HandleError(errno,"Failed to close listen socket: ");
+    listenFd=-1;
+    logger.Info()<<"Shuting down DNSReceiver worker thread"<<std::endl;
+}
+
+#ifdef HAVE_IO_URING
+//queue single io_uring request of given type, submit queue first if it is full
+bool DNSReceiver::UringQueue(IoUring &ring, const uint64_t type, const int fd)
+{
+    auto sqe=ring.GetSqe();
+    if(sqe==nullptr&&ring.Submit(0)==0)
+        sqe=ring.GetSqe();
+    if(sqe==nullptr)
+    {
+        logger.Error()<<"io_uring submission queue is full"<<std::endl;
+        return false;
+    }
+    sqe->fd=fd;
+    sqe->user_data=(type<<32)|static_cast<uint32_t>(fd);
+    if(type==URING_ACCEPT)
+    {
+        sqe->opcode=IORING_OP_ACCEPT;
+        sqe->ioprio=IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags=SOCK_CLOEXEC;
+    }
+    else if(type==URING_RECV)
+    {
+        sqe->opcode=IORING_OP_RECV;
+        sqe->ioprio=IORING_RECV_MULTISHOT;
+        sqe->flags=IOSQE_BUFFER_SELECT;
+        sqe->buf_group=ring.BufferGroup();
+    }
+    else
+    {
+        sqe->opcode=IORING_OP_POLL_ADD;
+        sqe->poll32_events=POLLIN;
+    }
+    return true;
+}
+
+//receive loop using multishot accept and multishot receive into provided buffers,
+//all completions available after single io_uring_enter call are processed at once.
+//returns false if io_uring is not supported, so regular receive loop must be used
+bool DNSReceiver::UringWorker()
+{
+    IoUring ring;
+    auto error=ring.Setup(URING_ENTRIES);
+    if(error==0)
+        error=ring.SetupBuffers(URING_BUF_GROUP,URING_BUF_COUNT,URING_BUF_SIZE);
+    if(error!=0)
+    {
+        logger.Warning()<<"io_uring is not available: "<<strerror(error)<<", using regular receive loop"<<std::endl;
+        return false;
+    }
 
-            if (bind(lSockFd,target,len)!=0)
+    auto lSockFd=CreateListenSocket();
+    if(lSockFd==-1)
+        return true;
+    if(!WaitListen(lSockFd))
+    {
+        close(lSockFd);
+        logger.Info()<<"Shuting down DNSReceiver worker thread"<<std::endl;
+        return true;
+    }
+    logger.Info()<<"Listening for incoming connections using io_uring"<<std::endl;
+
+    auto queued=UringQueue(ring,URING_WAKEUP,GetWakeupFd())&&UringQueue(ring,URING_ACCEPT,lSockFd);
+    while(queued&&!shutdownPending.load())
+    {
+        error=ring.Submit(1);
+        uringEnters++;
+        if(error!=0)
+        {
+            HandleError(error,"Error awaiting io_uring completions: ");
+            break;
+        }
+        auto ready=ring.CqReady();
+        for(unsigned i=0;i<ready&&queued;++i)
+        {
+            auto &cqe=ring.Cqe(i);
+            auto type=cqe.user_data>>32;
+            auto fd=static_cast<int>(cqe.user_data&0xFFFFFFFFULL);
+            auto more=(cqe.flags&IORING_CQE_F_MORE)!=0;
+            if(type==URING_ACCEPT)
             {
-                if(!bindFailWarned)
+                if(cqe.res>=0)
                 {
-                    bindFailWarned=true;
-                    logger.Warning()<<"Failed to bind listen socket: "<<strerror(errno)<<std::endl;
+                    linger cLinger={1,0};
+                    if (setsockopt(cqe.res, SOL_SOCKET, SO_LINGER, &cLinger, sizeof(linger))!=0)
+                        logger.Warning()<<"Failed to set SO_LINGER option to client socket: "<<strerror(errno)<<std::endl;
+                    clients[cqe.res]=std::unique_ptr<ClientStream>(new ClientStream());
+                    queued=UringQueue(ring,URING_RECV,cqe.res);
+                    logger.Info()<<"Client connected"<<std::endl;
                 }
-                std::this_thread::sleep_for(dTimeout);
-                continue;
+                else
+                    logger.Warning()<<"Failed to accept connection: "<<strerror(-cqe.res)<<std::endl;
+                if(!more)
+                    queued=queued&&UringQueue(ring,URING_ACCEPT,lSockFd);
             }
-            if (listen(lSockFd,1)!=0)
-            {
-                HandleError(errno,"Failed to setup listen socket: ");
-                return;
-            }
-            logger.Info()<<"Listening for incoming connection"<<std::endl;
-            bindComplete=true;
-
-            bool connAccepted=false;
-            while (!connAccepted && !shutdownPending.load())
+            else if(type==URING_RECV)
             {
-                //wait for new connection
-                fd_set lSet;
-                FD_ZERO(&lSet);
-                FD_SET(lSockFd, &lSet);
-                auto lt = timeout;
-                auto lrv = select(lSockFd+1, &lSet, NULL, NULL, &lt);
-                if(lrv==0) //no incoming connection detected
-                    continue;
-                if(lrv<0)
+                auto it=clients.find(fd);
+                if((cqe.flags&IORING_CQE_F_BUFFER)!=0)
                 {
-                    auto error=errno;
-                    if(error==EINTR)//interrupted by signal
-                        break;
-                    HandleError(error,"Error awaiting incoming connection: ");
-                    return;
+                    auto bid=static_cast<uint16_t>(cqe.flags>>IORING_CQE_BUFFER_SHIFT);
+                    if(cqe.res>0&&it!=clients.end())
+                        ConsumeData(*(it->second),ring.Buffer(bid),static_cast<size_t>(cqe.res));
+                    ring.RecycleBuffer(bid);
                 }
-
-                //accept single connection
-                sockaddr_storage cAddr;
-                socklen_t cAddrSz = sizeof(cAddr);
-                auto cSockFd=accept(lSockFd,reinterpret_cast<sockaddr*>(&cAddr),&cAddrSz);
-                if(cSockFd<1)
-                {
-                    logger.Warning()<<"Failed to accept connection: "<<strerror(errno)<<std::endl;
+                if(it==clients.end())
                     continue;
-                }
-                linger cLinger={1,0};
-                if (setsockopt(cSockFd, SOL_SOCKET, SO_LINGER, &cLinger, sizeof(linger))!=0)
-                    logger.Warning()<<"Failed to set SO_LINGER option to client socket: "<<strerror(errno)<<std::endl;
-                connAccepted=true;
-
-                logger.Info()<<"Client connected"<<std::endl;
-                //receive dnsdist packages until receive socket is receiving
-                bool headerPending=true;
-                size_t dataLeft=2;
-                size_t dataSize=2;
-                unsigned char data[65536]={}; //uint16_t header may only encode 64kib of data
-                while(!shutdownPending.load())
+                if(cqe.res==0)
                 {
-                    //wait for data
-                    fd_set cSet;
-                    FD_ZERO(&cSet);
-                    FD_SET(cSockFd, &cSet);
-                    auto ct = timeout;
-                    auto crv = select(cSockFd+1, &cSet, NULL, NULL, &ct);
-                    if(crv==0) //no incoming connection detected
-                        continue;
-                    if(crv<0)
-                    {
-                        auto error=errno;
-                        if(error==EINTR)//interrupted by signal
-                            break;
-                        HandleError(error,"Error awaiting data from client: ");
-                        return;
-                    }
-                    //read data
-                    auto dataRead=read(cSockFd,reinterpret_cast<void*>(data+dataSize-dataLeft),dataLeft);
-                    if(dataRead==0)
-                    {
-                        logger.Info()<<"Client disconnected"<<std::endl;
-                        break; //connection closed
-                    }
-                    if(dataRead<0)
-                    {
-                        logger.Warning()<<"Error reading data from client: "<<strerror(errno)<<std::endl;
-                        break;
-                    }
-                    dataLeft-=dataRead;
-                    if(dataLeft>0) //we still need to read more data
-                        continue;
-                    if(headerPending)
-                    {//decore header, setup read of data-payload
-                        dataSize=DecodeHeader(data);
-                        if(dataSize<1)
-                            dataSize=2; //zero sized payload, setup read for another header
-                        else
-                            headerPending=false;
-                        dataLeft=dataSize;
-                    }
-                    else
-                    {//decode payload, setup read of next data-header
-                        //decode payload
-                        PBDNSMessage message;
-                        if(!message.ParseFromArray(data,static_cast<int>(dataSize)))
-                            logger.Warning()<<"Failed to decode payload of size "<<dataSize<<std::endl;
-                        else if(!message.has_response() || message.response().rrs_size()<1)
-                            logger.Warning()<<"No valid response or dns resource records provided in dnsdist message"<<std::endl;
-                        else
-                            //parse dns resource records
-                            for(auto rIdx=0;rIdx<message.response().rrs_size();++rIdx)
-                            {
-                                auto record=message.response().rrs(rIdx);
-                                std::string name=record.has_name()?record.name():"<NO NAME>";
-                                auto type=record.has_type()?record.type():0;
-                                auto ttl=record.has_ttl()?record.ttl():0;
-                                auto rdata=record.has_rdata()?record.rdata():std::string();
-                                if(rdata.empty()||(type!=1&&type!=28))
-                                    logger.Warning()<<"Unsupported dns resource record provided -> name="<<name<<",type="<<type<<",ttl="<<ttl<<",rdata len="<<rdata.length()<<std::endl;
-                                else
-                                {
-                                    IPAddress ip(rdata.data(),rdata.length());
-                                    if(!ip.isValid)
-                                        logger.Warning()<<"Invalid ip address decoded for response -> name="<<name<<",type="<<type<<",ttl="<<ttl<<",rdata len="<<rdata.length()<<std::endl;
-                                    else
-                                    {
-                                        logger.Info()<<"Valid response decoded -> name="<<name<<",ip="<<ip<<",type="<<type<<",ttl="<<ttl<<std::endl;
-                                        sender.SendMessage(this,RouteRequestMessage(ip,ttl));
-                                    }
-                                }
-                            }
-
-                        //setup reading of new package
-                        headerPending=true;
-                        dataSize=dataLeft=2;
-                    }
+                    logger.Info()<<"Client disconnected"<<std::endl;
+                    CloseClient(fd);
                 }
-
-                logger.Info()<<"Closing client connection"<<std::endl;
-                if(close(cSockFd)!=0)
+                else if(cqe.res<0&&cqe.res!=-ENOBUFS)
                 {
-                    HandleError(errno,"Failed to close client socket: ");
-                    return;
+                    logger.Warning()<<"Error reading data from client: "<<strerror(-cqe.res)<<std::endl;
+                    CloseClient(fd);
                 }
+                else if(!more) //receive buffers was exhausted, or kernel stopped multishot request
+                    queued=UringQueue(ring,URING_RECV,fd);
             }
         }
-        if(close(lSockFd)!=0)
+        ring.CqAdvance(ready);
+        uringCompletions+=ready;
+    }
+
+    CloseClients();
+    if(close(lSockFd)!=0)
+        HandleError(errno,"Failed to close listen socket: ");
+    logger.Info()<<"Shuting down DNSReceiver worker thread"<<std::endl;
+    return true;
+}
+#endif
+
+bool DNSReceiver::Attach(Reactor &_reactor)
+{
+    reactor=&_reactor;
+    listenFd=CreateListenSocket();
+    if(listenFd==-1)
+        return false;
+    if(fcntl(listenFd,F_SETFL,fcntl(listenFd,F_GETFL)|O_NONBLOCK)!=0)
+    {
+        HandleError(errno,"Failed to set non-blocking mode for listen socket: ");
+        return false;
+    }
+    return StartListening();
+}
+
+//bind and register listen socket with reactor, failed bind is retried by timer
+bool DNSReceiver::StartListening()
+{
+    if(!BindListenSocket(listenFd,reactorBindWarned))
+    {
+        if(retryTimer==-1)
         {
-            HandleError(errno,"Failed to close listen socket: ");
-            return;
+            retryTimer=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+            if(retryTimer==-1)
+            {
+                HandleError(errno,"Failed to create timerfd: ");
+                return false;
+            }
+            if(!reactor->Add(retryTimer,*this))
+                return false;
         }
+        itimerspec spec={};
+        spec.it_value.tv_sec=timeout.tv_sec;
+        spec.it_value.tv_nsec=timeout.tv_usec*1000;
+        if(timerfd_settime(retryTimer,0,&spec,nullptr)!=0)
+        {
+            HandleError(errno,"Failed to set timerfd: ");
+            return false;
+        }
+        return true;
+    }
+    if(retryTimer!=-1)
+    {
+        reactor->Remove(retryTimer);
+        close(retryTimer);
+        retryTimer=-1;
+    }
+    //multiple clients are served at once
+    if(listen(listenFd,SOMAXCONN)!=0)
+    {
+        HandleError(errno,"Failed to setup listen socket: ");
+        return false;
+    }
+    logger.Info()<<"Listening for incoming connections"<<std::endl;
+    return reactor->Add(listenFd,*this);
+}
+
+void DNSReceiver::OnReactorEvent(const int fd, const uint32_t)
+{
+    if(fd==retryTimer)
+    {
+        uint64_t expirations=0;
+        if(read(retryTimer,&expirations,sizeof(expirations))==sizeof(expirations))
+            StartListening();
+        return;
     }
 
-    logger.Info()<<"Shuting down DNSReceiver worker thread"<<std::endl;
+    if(fd==listenFd)
+    {
+        auto cSockFd=AcceptClient();
+        if(cSockFd!=-1&&!reactor->Add(cSockFd,*this))
+        {
+            clients.erase(cSockFd);
+            close(cSockFd);
+        }
+        return;
+    }
+
+    ServeClient(fd);
+}
+
+void DNSReceiver::Detach()
+{
+    if(reactor==nullptr)
+        return;
+    CloseClients();
+    if(retryTimer!=-1)
+    {
+        reactor->Remove(retryTimer);
+        close(retryTimer);
+        retryTimer=-1;
+    }
+    if(listenFd!=-1)
+    {
+        reactor->Remove(listenFd);
+        if(close(listenFd)!=0)
+            logger.Warning()<<"Failed to close listen socket: "<<strerror(errno)<<std::endl;
+        listenFd=-1;
+    }
+    reactor=nullptr;
+    logger.Info()<<"Detaching DNSReceiver from reactor"<<std::endl;
 }
@@ -5,24 +5,112 @@
 #include "IPAddress.h"
 #include "WorkerBase.h"
 #include "IMessageSender.h"
+#include "IRouteState.h"
+#include "DomainFilter.h"
+#include "AddressFilter.h"
+#include "IReactorHandler.h"
+#include "Reactor.h"
+#include "IoUring.h"
 
 #include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <sys/time.h>
 
-class DNSReceiver : public WorkerBase
+class DNSReceiver : public WorkerBase, public IReactorHandler
 {
     private:
+        //receive state of the single client connection: 2-byte length header followed by dnsdist message
+        struct ClientStream
+        {
+            bool headerPending=true;
+            size_t dataLeft=2;
+            size_t dataSize=2;
+            unsigned char data[65536]; //uint16_t header may only encode 64kib of data
+        };
+        enum ClientReadResult {CLIENT_DATA, CLIENT_WOULDBLOCK, CLIENT_CLOSED};
+        //last route request sent for the address: expiration time and route removal generation of the profile at that moment
+        struct DedupRecord
+        {
+            uint64_t expiry;
+            uint64_t generation;
+        };
+
         ILogger &logger;
         IMessageSender &sender;
-        const timeval timeout;
+        const std::vector<IMessageSender*> profileSenders; //route requests are sent to the profile selected by domain filter
+        const std::vector<const IRouteState*> routeStates; //route state of every profile, used to invalidate deduplication
+        const timeval timeout; //interval between attempts to bind listen socket
         const IPAddress listenAddr;
         const int port;
+        const unsigned int dedupGranularity; //seconds, 0 - deduplication disabled
+        const bool useUring; //use io_uring receive loop if supported by kernel
+        const int cpu; //cpu to pin worker thread to, -1 - not pinned
         std::atomic<bool> shutdownPending;
+        std::shared_ptr<const DomainFilter> domainFilter; //must be accessed only with std::atomic_load/atomic_store
+        std::atomic<uint64_t> recordsAccepted;
+        std::atomic<uint64_t> recordsFiltered;
+        std::shared_ptr<const AddressFilter> addressFilter; //must be accessed only with std::atomic_load/atomic_store
+        std::atomic<uint64_t> addrAllowHits;
+        std::atomic<uint64_t> addrDenyHits;
+        std::atomic<uint64_t> addrNotAllowed;
+        //filter match results cache, used only from worker thread and dropped when filter is replaced
+        std::shared_ptr<const DomainFilter> cacheFilter;
+        std::unordered_map<std::string,int> matchCache;
+        //last route request sent for every address, per profile. used only from worker thread
+        std::vector<std::unordered_map<IPAddress,DedupRecord>> dedupCache;
+        //route requests decoded from the current message, per profile. used only from worker thread
+        std::vector<std::vector<RouteRequest>> requestBatches;
+        std::atomic<uint64_t> requestsSent;
+        std::atomic<uint64_t> requestsSuppressed;
+        std::atomic<uint64_t> messagesDecoded;
+        std::atomic<uint64_t> uringEnters;
+        std::atomic<uint64_t> uringCompletions;
+        //listen socket and connected clients, used only from worker or reactor thread
+        int listenFd=-1;
+        std::unordered_map<int,std::unique_ptr<ClientStream>> clients;
+        //reactor mode state, used only from reactor thread
+        Reactor *reactor=nullptr;
+        int retryTimer=-1;
+        bool reactorBindWarned=false;
 
+        int MatchCached(const std::string &name);
+        int MatchProfile(const std::string &qName, const std::string &rrName);
+        bool CheckAddress(const IPAddress &ip);
+        bool IsDuplicate(const size_t profile, const IPAddress &ip, const unsigned int ttl, const bool udr);
+        void ProcessPayload(const unsigned char * const data, const size_t dataSize);
+        ClientReadResult ReadClient(const int fd, ClientStream &stream);
+        void CompleteFrame(ClientStream &stream);
+        void ConsumeData(ClientStream &stream, const unsigned char *data, size_t len);
+#ifdef HAVE_IO_URING
+        bool UringQueue(IoUring &ring, const uint64_t type, const int fd);
+        bool UringWorker();
+#endif
+        int CreateListenSocket();
+        bool BindListenSocket(const int lSockFd, bool &failWarned);
+        bool WaitListen(const int lSockFd);
+        bool StartListening();
+        void PinWorker();
+        int AcceptClient();
+        void ServeClient(const int fd);
+        void CloseClient(const int fd);
+        void CloseClients();
         void HandleError(int ec, const std::string& message);
         void HandleError(const std::string &message);
     public:
-        DNSReceiver(ILogger &logger, IMessageSender &sender, const timeval timeout, const IPAddress listenAddr, const int port);
+        DNSReceiver(ILogger &logger, IMessageSender &sender, const std::vector<IMessageSender*> &profileSenders, const std::vector<const IRouteState*> &routeStates, const timeval timeout, const IPAddress listenAddr, const int port, const unsigned int dedupGranularity, const bool useUring, const int cpu);
+        //set new domain filter, may be called from any thread. nullptr - send all records to the first profile
+        void SetDomainFilter(const std::shared_ptr<const DomainFilter> &filter);
+        //set new destination address filter, may be called from any thread. nullptr - accept all addresses
+        void SetAddressFilter(const std::shared_ptr<const AddressFilter> &filter);
+        void LogStats();
+        //reactor mode, used instead of Startup/Shutdown
+        bool Attach(Reactor &reactor);
+        void Detach();
+        //IReactorHandler
+        void OnReactorEvent(const int fd, const uint32_t events) final;
     protected: //WorkerBase
         void Worker() final;
         void OnShutdown() final;
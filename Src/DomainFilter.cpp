@@ -0,0 +1,141 @@
+#include "DomainFilter.h"
+
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <cctype>
+
+//temporary tree used to build compiled trie
+struct BuildNode
+{
+    int value=DomainFilter::NoMatch;
+    std::map<std::string,std::unique_ptr<BuildNode>> children;
+};
+
+//split normalized domain name into labels in reverse order, empty labels are kept
+static std::vector<std::string> ReverseLabels(const std::string &name)
+{
+    std::vector<std::string> result;
+    if(name.empty())
+        return result;
+    size_t end=name.length();
+    while(true)
+    {
+        //leading dot leaves empty label at the start of the name
+        auto pos=end>0?name.rfind('.',end-1):std::string::npos;
+        auto start=pos==std::string::npos?0:pos+1;
+        result.push_back(name.substr(start,end-start));
+        if(pos==std::string::npos)
+            return result;
+        end=pos;
+    }
+}
+
+std::string DomainFilter::Normalize(const std::string &name)
+{
+    std::string result(name);
+    for(auto &ch : result)
+        ch=static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    while(!result.empty()&&result.back()=='.')
+        result.pop_back();
+    auto first=result.find_first_not_of('.');
+    return first==std::string::npos?std::string():result.substr(first);
+}
+
+DomainFilter::DomainFilter(const std::vector<std::pair<std::string,int>> &rules):
+    ruleCount(0)
+{
+    BuildNode root;
+    for(auto const &el : rules)
+    {
+        auto const &rule=el.first;
+        auto exclude=!rule.empty()&&rule.front()=='!';
+        auto name=Normalize(exclude?rule.substr(1):rule);
+        auto labels=ReverseLabels(name);
+        if(rule==(exclude?"!.":".")) //root
+            labels.clear();
+        else if(labels.empty())
+        {
+            error="invalid rule: "+rule;
+            continue;
+        }
+        auto node=&root;
+        bool valid=true;
+        for(auto const &label : labels)
+        {
+            if(label.empty())
+            {
+                valid=false;
+                break;
+            }
+            auto &child=node->children[label];
+            if(!child)
+                child.reset(new BuildNode());
+            node=child.get();
+        }
+        if(!valid)
+        {
+            error="invalid rule: "+rule;
+            continue;
+        }
+        auto value=exclude?Exclude:el.second;
+        if(node->value!=NoMatch&&node->value!=value)
+        {
+            error="conflicting rule: "+rule;
+            continue;
+        }
+        if(node->value==NoMatch)
+            ruleCount++;
+        node->value=value;
+    }
+
+    //compile tree to flat arrays, breadth-first so children of every node are stored sequentially
+    std::vector<const BuildNode*> queue={&root};
+    nodes.push_back(Node{0,0,root.value});
+    for(size_t i=0;i<queue.size();++i)
+    {
+        auto src=queue[i];
+        nodes[i].edgeStart=static_cast<uint32_t>(edges.size());
+        nodes[i].edgeCount=static_cast<uint32_t>(src->children.size());
+        for(auto const &child : src->children) //std::map keeps labels sorted
+        {
+            edges.push_back(Edge{child.first,static_cast<uint32_t>(queue.size())});
+            nodes.push_back(Node{0,0,child.second->value});
+            queue.push_back(child.second.get());
+        }
+    }
+}
+
+int DomainFilter::Match(const std::string &name) const
+{
+    auto labels=ReverseLabels(Normalize(name));
+    uint32_t node=0;
+    int result=nodes[0].value;
+    for(auto const &label : labels)
+    {
+        auto first=edges.begin()+nodes[node].edgeStart;
+        auto last=first+nodes[node].edgeCount;
+        auto it=std::lower_bound(first,last,label,[](const Edge &edge, const std::string &val){return edge.label<val;});
+        if(it==last||it->label!=label)
+            break;
+        node=it->node;
+        if(nodes[node].value!=NoMatch)
+            result=nodes[node].value;
+    }
+    return result;
+}
+
+size_t DomainFilter::RuleCount() const
+{
+    return ruleCount;
+}
+
+bool DomainFilter::IsValid() const
+{
+    return error.empty();
+}
+
+const std::string& DomainFilter::GetError() const
+{
+    return error;
+}
@@ -0,0 +1,47 @@
+#ifndef DOMAINFILTER_H
+#define DOMAINFILTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+
+//compiled trie of domain suffixes with reversed labels (com -> example -> www),
+//used to decide whether dns answer for the given name should produce routes.
+//the most specific matching suffix wins, so "example.com" may be included while "ads.example.com" is excluded.
+//instance is immutable after construction and may be shared between threads.
+class DomainFilter
+{
+    public:
+        static const int NoMatch=-1;
+        static const int Exclude=-2;
+    private:
+        //node of the compiled trie, children are stored as sorted range in the edges vector
+        struct Node
+        {
+            uint32_t edgeStart;
+            uint32_t edgeCount;
+            int value;
+        };
+        struct Edge
+        {
+            std::string label;
+            uint32_t node;
+        };
+        std::vector<Node> nodes;
+        std::vector<Edge> edges;
+        size_t ruleCount;
+        std::string error;
+    public:
+        //rules: "suffix" to include names ending with suffix, "!suffix" to exclude, "." matches any name.
+        //every rule is paired with value returned by Match for include rule (i.e. profile index), must be >= 0
+        DomainFilter(const std::vector<std::pair<std::string,int>> &rules);
+        //value of the most specific matching rule: value of include rule, Exclude or NoMatch
+        int Match(const std::string &name) const;
+        size_t RuleCount() const;
+        bool IsValid() const;
+        const std::string& GetError() const;
+        static std::string Normalize(const std::string &name); //lowercase, without leading and trailing dots
+};
+
+#endif // DOMAINFILTER_H
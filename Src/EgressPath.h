@@ -0,0 +1,19 @@
+#ifndef EGRESSPATH_H
+#define EGRESSPATH_H
+
+#include "IPAddress.h"
+
+#include <string>
+
+//network interface with optional gateways, used as a path for generated routes
+class EgressPath
+{
+    public:
+        EgressPath(const std::string &_ifname, const IPAddress &_gateway4, const IPAddress &_gateway6):ifname(_ifname),gateway4(_gateway4),gateway6(_gateway6){}
+        const std::string ifname;
+        const IPAddress gateway4;
+        const IPAddress gateway6;
+        const IPAddress& Gateway(const bool isV6) const {return isV6?gateway6:gateway4;}
+};
+
+#endif // EGRESSPATH_H
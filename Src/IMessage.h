@@ -2,16 +2,20 @@
 #define IMESSAGE_H
 
 #include "InterfaceConfig.h"
+#include "IPNetwork.h"
 #include <vector>
+#include <string>
+#include <cstdint>
 
 enum MsgType
 {
     MSG_SHUTDOWN,
     MSG_NETDEV_UPDATE,
     MSG_ROUTE_REQUEST,
-    MSG_ROUTE_ADDED,
-    MSG_ROUTE_REMOVED,
+    MSG_ROUTE_CONFIRM,
     MSG_SAVE_ROUTE,
+    MSG_FIB_UPDATE,
+    MSG_ROUTES_RESYNC,
 };
 
 class IMessage
@@ -33,34 +37,66 @@ class IShutdownMessage : public IMessage
 class INetDevUpdateMessage : public IMessage
 {
     protected:
-        INetDevUpdateMessage(InterfaceConfig &_config):IMessage(MSG_NETDEV_UPDATE),config(_config){}
+        INetDevUpdateMessage(const std::string &_ifname, const InterfaceConfigPtr &_config, const uint64_t _timestamp):IMessage(MSG_NETDEV_UPDATE),ifname(_ifname),config(_config),timestamp(_timestamp){}
     public:
-        const InterfaceConfig config;
+        const std::string ifname;
+        const InterfaceConfigPtr config; //immutable snapshot, shared with sender
+        const uint64_t timestamp; //monotonic time in microseconds, when interface state change was detected
 };
 
+struct RouteRequest
+{
+    RouteRequest(const IPAddress &_ip, const unsigned int _ttl):ip(_ip),ttl(_ttl){}
+    IPAddress ip;
+    unsigned int ttl;
+};
+
+//all route requests decoded from the single dnsdist message
 class IRouteRequestMessage : public IMessage
 {
     protected:
-        IRouteRequestMessage(const IPAddress &_ip, const unsigned int _ttl):IMessage(MSG_ROUTE_REQUEST),ip(_ip),ttl(_ttl){}
+        IRouteRequestMessage(const std::vector<RouteRequest> &_requests):IMessage(MSG_ROUTE_REQUEST),requests(_requests){}
+    public:
+        const std::vector<RouteRequest> &requests;
+};
+
+struct RouteConfirmation
+{
+    RouteConfirmation(const IPNetwork &_dest, const std::string &_ifname, const bool _isAdd):dest(_dest),ifname(_ifname),isAdd(_isAdd){}
+    IPNetwork dest;
+    std::string ifname; //empty if route is using nexthop object without interface reported
+    bool isAdd; //route was added, or removed otherwise
+};
+
+//route added and removed notifications from the single netlink read, in order of arrival
+class IRouteConfirmMessage : public IMessage
+{
+    protected:
+        IRouteConfirmMessage(const std::vector<RouteConfirmation> &_confirmations):IMessage(MSG_ROUTE_CONFIRM),confirmations(_confirmations){}
     public:
-        const IPAddress &ip;
-        const unsigned int ttl;
+        const std::vector<RouteConfirmation> &confirmations;
 };
 
-class IRouteAddedMessage : public IMessage
+//route not managed by this program was added or removed from the main routing table
+class IFibUpdateMessage : public IMessage
 {
     protected:
-        IRouteAddedMessage(const IPAddress &_ip):IMessage(MSG_ROUTE_ADDED),ip(_ip){}
+        IFibUpdateMessage(const IPNetwork &_dest, const unsigned int _ifIdx, const IPAddress &_gateway, const int _metric, const bool _isAdd):IMessage(MSG_FIB_UPDATE),dest(_dest),ifIdx(_ifIdx),gateway(_gateway),metric(_metric),isAdd(_isAdd){}
     public:
-        const IPAddress &ip;
+        const IPNetwork &dest;
+        const unsigned int ifIdx;
+        const IPAddress &gateway;
+        const int metric;
+        const bool isAdd;
 };
 
-class IRouteRemovedMessage : public IMessage
+//routes dump requested after lost netlink notifications is complete, route state must be reconciled with kernel
+class IRoutesResyncMessage : public IMessage
 {
     protected:
-        IRouteRemovedMessage(const IPAddress &_ip):IMessage(MSG_ROUTE_REMOVED),ip(_ip){}
+        IRoutesResyncMessage(const std::string &_ifname):IMessage(MSG_ROUTES_RESYNC),ifname(_ifname){}
     public:
-        const IPAddress &ip;
+        const std::string ifname;
 };
 
 #endif // IMESSAGE_H
@@ -0,0 +1,146 @@
+#include "IPNetwork.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+
+static int MaxPrefixLen(const IPAddress &ip)
+{
+    return ip.isV6?IPV6_ADDR_LEN*8:IPV4_ADDR_LEN*8;
+}
+
+static bool IsPrefixLenValid(const IPAddress &ip, const int prefixLen)
+{
+    return ip.isValid && prefixLen>=0 && prefixLen<=MaxPrefixLen(ip);
+}
+
+//zero all bits of ip-address that are not covered by the prefix
+static IPAddress MaskIP(const IPAddress &ip, const int prefixLen)
+{
+    if(!IsPrefixLenValid(ip,prefixLen))
+        return IPAddress();
+    auto len=ip.isV6?IPV6_ADDR_LEN:IPV4_ADDR_LEN;
+    unsigned char raw[IP_ADDR_LEN]={};
+    std::memcpy(reinterpret_cast<void*>(raw),ip.RawData(),static_cast<size_t>(len));
+    for(auto i=0;i<len;++i)
+    {
+        auto bits=prefixLen-i*8;
+        if(bits>=8)
+            continue;
+        raw[i]=bits<=0?0:static_cast<unsigned char>(raw[i]&(0xFF<<(8-bits)));
+    }
+    return IPAddress(raw,static_cast<size_t>(len));
+}
+
+static std::string DecodeAddrPart(const std::string &string)
+{
+    auto pos=string.find('/');
+    return pos==std::string::npos?string:string.substr(0,pos);
+}
+
+static int DecodePrefixLen(const std::string &string)
+{
+    auto pos=string.find('/');
+    if(pos==std::string::npos)
+        return MaxPrefixLen(IPAddress(string));
+    auto lenStr=string.substr(pos+1);
+    if(lenStr.empty()||lenStr.length()>3||lenStr.find_first_not_of("0123456789")!=std::string::npos)
+        return -1;
+    return std::atoi(lenStr.c_str());
+}
+
+IPNetwork::IPNetwork():
+    ip(IPAddress()),
+    prefixLen(0),
+    isValid(false),
+    isV6(false)
+{
+}
+
+IPNetwork::IPNetwork(const IPNetwork& other):
+    ip(other.ip),
+    prefixLen(other.prefixLen),
+    isValid(other.isValid),
+    isV6(other.isV6)
+{
+}
+
+IPNetwork::IPNetwork(const IPAddress& _ip):
+    IPNetwork(_ip,MaxPrefixLen(_ip))
+{
+}
+
+IPNetwork::IPNetwork(const IPAddress& _ip, const int _prefixLen):
+    ip(MaskIP(_ip,_prefixLen)),
+    prefixLen(IsPrefixLenValid(_ip,_prefixLen)?_prefixLen:0),
+    isValid(IsPrefixLenValid(_ip,_prefixLen)),
+    isV6(IsPrefixLenValid(_ip,_prefixLen)&&_ip.isV6)
+{
+}
+
+IPNetwork::IPNetwork(const std::string &string):
+    IPNetwork(IPAddress(DecodeAddrPart(string)),DecodePrefixLen(string))
+{
+}
+
+bool IPNetwork::Contains(const IPAddress& target) const
+{
+    if(!isValid||!target.isValid||target.isV6!=isV6)
+        return false;
+    return MaskIP(target,prefixLen)==ip;
+}
+
+bool IPNetwork::Contains(const IPNetwork& target) const
+{
+    return target.isValid && target.prefixLen>=prefixLen && Contains(target.ip);
+}
+
+bool IPNetwork::IsHost() const
+{
+    return isValid && prefixLen==MaxPrefixLen(ip);
+}
+
+std::string IPNetwork::ToString() const
+{
+    std::ostringstream result;
+    result<<*this;
+    return result.str();
+}
+
+size_t IPNetwork::GetHashCode() const
+{
+    return ip.GetHashCode()^(static_cast<size_t>(prefixLen)<<16);
+}
+
+bool IPNetwork::Equals(const IPNetwork& other) const
+{
+    return prefixLen==other.prefixLen && ip.Equals(other.ip);
+}
+
+bool IPNetwork::Less(const IPNetwork& other) const
+{
+    if(ip.Less(other.ip))
+        return true;
+    return ip.Equals(other.ip) && prefixLen<other.prefixLen;
+}
+
+bool IPNetwork::operator<(const IPNetwork &other) const
+{
+    return Less(other);
+}
+
+bool IPNetwork::operator==(const IPNetwork& other) const
+{
+    return Equals(other);
+}
+
+bool IPNetwork::operator!=(const IPNetwork& other) const
+{
+    return !Equals(other);
+}
+
+std::ostream& operator<<(std::ostream& stream, const IPNetwork& target)
+{
+    stream<<target.ip<<"/"<<target.prefixLen;
+    return stream;
+}
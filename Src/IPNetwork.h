@@ -0,0 +1,41 @@
+#ifndef IPNETWORK_H
+#define IPNETWORK_H
+
+#include "IPAddress.h"
+
+#include <iostream>
+#include <string>
+
+//ip network: address with prefix length, host bits are always zeroed on construction
+class IPNetwork
+{
+    public:
+        IPNetwork();
+        IPNetwork(const IPNetwork &other);
+        IPNetwork(const IPAddress &ip); //host network, prefix length is 32 or 128
+        IPNetwork(const IPAddress &ip, const int prefixLen);
+        IPNetwork(const std::string &string); //"ip-addr" or "ip-addr/prefix-len"
+
+        bool Contains(const IPAddress &target) const;
+        bool Contains(const IPNetwork &target) const;
+        bool IsHost() const;
+        std::string ToString() const;
+
+        size_t GetHashCode() const;
+        bool Equals(const IPNetwork &other) const;
+        bool Less(const IPNetwork &other) const;
+        bool operator<(const IPNetwork &other) const;
+        bool operator==(const IPNetwork &other) const;
+        bool operator!=(const IPNetwork &other) const;
+
+        friend std::ostream& operator<<(std::ostream& stream, const IPNetwork& target);
+
+        const IPAddress ip;
+        const int prefixLen;
+        const bool isValid;
+        const bool isV6;
+};
+
+namespace std { template<> struct hash<IPNetwork>{ size_t operator()(const IPNetwork &target) const {return target.GetHashCode();}}; }
+
+#endif // IPNETWORK_H
@@ -0,0 +1,13 @@
+#ifndef IREACTORHANDLER_H
+#define IREACTORHANDLER_H
+
+#include <cstdint>
+
+class IReactorHandler
+{
+    public:
+        //called from reactor thread when registered descriptor is ready, events is a mask of EPOLL* flags
+        virtual void OnReactorEvent(const int fd, const uint32_t events) = 0;
+};
+
+#endif // IREACTORHANDLER_H
@@ -0,0 +1,16 @@
+#ifndef IROUTESTATE_H
+#define IROUTESTATE_H
+
+#include "IPAddress.h"
+
+#include <cstdint>
+
+class IRouteState
+{
+    public:
+        //changes every time a route that may serve the address is removed or refused, may be called from any thread.
+        //requests sent for the address before the change must not be suppressed as duplicates
+        virtual uint64_t RemovalGeneration(const IPAddress &ip) const = 0;
+};
+
+#endif // IROUTESTATE_H
@@ -4,7 +4,9 @@ InterfaceConfig::InterfaceConfig():
     isUp(false),
     isPtP(false),
     localIPs(),
-    remoteIPs()
+    remoteIPs(),
+    ipv4Avail(false),
+    ipv6Avail(false)
 {
 }
 
@@ -13,70 +15,88 @@ InterfaceConfig::InterfaceConfig(const InterfaceConfig& other):
 {
 }
 
+static bool HasAddress(const std::set<IPAddress> &ips, const bool isV6)
+{
+    for(auto const &el: ips)
+        if(el.isValid && el.isV6==isV6)
+            return true;
+    return false;
+}
+
 InterfaceConfig::InterfaceConfig(const bool _isUp, const bool _isPtP, const std::set<IPAddress> &_localIPs, const std::set<IPAddress> &_remoteIPs):
     isUp(_isUp),
     isPtP(_isPtP),
     localIPs(_localIPs),
-    remoteIPs(_remoteIPs)
+    remoteIPs(_remoteIPs),
+    ipv4Avail(_isUp&&HasAddress(_localIPs,false)),
+    ipv6Avail(_isUp&&HasAddress(_localIPs,true))
 {
 }
 
-InterfaceConfig InterfaceConfig::AddLocalIP(const IPAddress& ip) const
+InterfaceConfigBuilder::InterfaceConfigBuilder():
+    isUp(false),
+    isPtP(false),
+    localIPs(),
+    remoteIPs(),
+    isUpdated(false)
 {
-    auto tmpSet(localIPs);
-    tmpSet.insert(ip);
-    return InterfaceConfig(isUp,isPtP,tmpSet,remoteIPs);
 }
 
-InterfaceConfig InterfaceConfig::DelLocalIP(const IPAddress& ip) const
+InterfaceConfigBuilder::InterfaceConfigBuilder(const InterfaceConfig &base):
+    isUp(base.isUp),
+    isPtP(base.isPtP),
+    localIPs(base.localIPs),
+    remoteIPs(base.remoteIPs),
+    isUpdated(false)
 {
-    auto tmpSet(localIPs);
-    tmpSet.erase(ip);
-    return InterfaceConfig(isUp,isPtP,tmpSet,remoteIPs);
 }
 
-InterfaceConfig InterfaceConfig::AddRemoteIP(const IPAddress& ip) const
+InterfaceConfigBuilder& InterfaceConfigBuilder::AddLocalIP(const IPAddress& ip)
 {
-    auto tmpSet(remoteIPs);
-    tmpSet.insert(ip);
-    return InterfaceConfig(isUp,isPtP,localIPs,tmpSet);
+    isUpdated|=localIPs.insert(ip).second;
+    return *this;
 }
 
-InterfaceConfig InterfaceConfig::DelRemoteIP(const IPAddress& ip) const
+InterfaceConfigBuilder& InterfaceConfigBuilder::DelLocalIP(const IPAddress& ip)
 {
-    auto tmpSet(remoteIPs);
-    tmpSet.erase(ip);
-    return InterfaceConfig(isUp,isPtP,localIPs,tmpSet);
+    isUpdated|=localIPs.erase(ip)>0;
+    return *this;
 }
 
-InterfaceConfig InterfaceConfig::SetState(const bool _isUp) const
+InterfaceConfigBuilder& InterfaceConfigBuilder::AddRemoteIP(const IPAddress& ip)
 {
-    return InterfaceConfig(_isUp,isPtP,localIPs,remoteIPs);
+    isUpdated|=remoteIPs.insert(ip).second;
+    return *this;
 }
 
-InterfaceConfig InterfaceConfig::SetType(const bool _isPtP) const
+InterfaceConfigBuilder& InterfaceConfigBuilder::DelRemoteIP(const IPAddress& ip)
 {
-    return InterfaceConfig(isUp,_isPtP,localIPs,remoteIPs);
+    isUpdated|=remoteIPs.erase(ip)>0;
+    return *this;
 }
 
-bool InterfaceConfig::isIPV4Avail() const
+InterfaceConfigBuilder& InterfaceConfigBuilder::SetState(const bool _isUp)
 {
-    if(!isUp)
-        return false;
-    for(auto el: localIPs)
-        if(el.isValid && !el.isV6)
-            return true;
-    return false;
+    isUpdated|=isUp!=_isUp;
+    isUp=_isUp;
+    return *this;
 }
 
-bool InterfaceConfig::isIPV6Avail() const
+InterfaceConfigBuilder& InterfaceConfigBuilder::SetType(const bool _isPtP)
 {
-    if(!isUp)
-        return false;
-    for(auto el: localIPs)
-        if(el.isValid && el.isV6)
-            return true;
-    return false;
+    isUpdated|=isPtP!=_isPtP;
+    isPtP=_isPtP;
+    return *this;
+}
+
+InterfaceConfigPtr InterfaceConfigBuilder::Build() const
+{
+    return std::make_shared<const InterfaceConfig>(isUp,isPtP,localIPs,remoteIPs);
+}
+
+bool InterfaceConfig::Equals(const InterfaceConfig &other) const
+{
+    return isUp==other.isUp && isPtP==other.isPtP && localIPs==other.localIPs && remoteIPs==other.remoteIPs;
 }
 
 std::ostream& operator<<(std::ostream& stream, const InterfaceConfig& target)
@@ -3,8 +3,10 @@
 
 #include "IPAddress.h"
 #include <set>
+#include <memory>
 #include <iostream>
 
+//immutable interface state, published as shared snapshot. availability flags are computed once on construction
 class InterfaceConfig
 {
     public:
@@ -15,17 +17,38 @@ class InterfaceConfig
         const bool isPtP;
         const std::set<IPAddress> localIPs;
         const std::set<IPAddress> remoteIPs;
+        const bool ipv4Avail; //interface is up and has valid ipv4 address
+        const bool ipv6Avail; //interface is up and has valid ipv6 address
 
-        InterfaceConfig AddLocalIP(const IPAddress &ip) const;
-        InterfaceConfig DelLocalIP(const IPAddress &ip) const;
-        InterfaceConfig AddRemoteIP(const IPAddress &ip) const;
-        InterfaceConfig DelRemoteIP(const IPAddress &ip) const;
-        InterfaceConfig SetState(const bool isUp) const;
-        InterfaceConfig SetType(const bool isPtP) const;
-        bool isIPV4Avail() const;
-        bool isIPV6Avail() const;
+        bool isIPV4Avail() const { return ipv4Avail; }
+        bool isIPV6Avail() const { return ipv6Avail; }
+        bool Equals(const InterfaceConfig &other) const;
 
         friend std::ostream& operator<<(std::ostream& stream, const InterfaceConfig& target);
 };
 
+typedef std::shared_ptr<const InterfaceConfig> InterfaceConfigPtr;
+
+//mutable interface state, used to apply all changes from the single netlink batch and publish them as one new snapshot
+class InterfaceConfigBuilder
+{
+    private:
+        bool isUp;
+        bool isPtP;
+        std::set<IPAddress> localIPs;
+        std::set<IPAddress> remoteIPs;
+    public:
+        InterfaceConfigBuilder();
+        InterfaceConfigBuilder(const InterfaceConfig &base);
+        bool isUpdated; //any field was actually changed since construction
+
+        InterfaceConfigBuilder& AddLocalIP(const IPAddress &ip);
+        InterfaceConfigBuilder& DelLocalIP(const IPAddress &ip);
+        InterfaceConfigBuilder& AddRemoteIP(const IPAddress &ip);
+        InterfaceConfigBuilder& DelRemoteIP(const IPAddress &ip);
+        InterfaceConfigBuilder& SetState(const bool isUp);
+        InterfaceConfigBuilder& SetType(const bool isPtP);
+        InterfaceConfigPtr Build() const;
+};
+
 #endif // INTERFACECONFIG_H
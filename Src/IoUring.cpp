@@ -0,0 +1,177 @@
+#include "IoUring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int io_uring_setup(unsigned entries, io_uring_params *p)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup,entries,p));
+}
+
+static int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter,fd,toSubmit,minComplete,flags,nullptr,0));
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nrArgs)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register,fd,opcode,arg,nrArgs));
+}
+
+template <class T> static T* RingField(void *ring, const uint32_t offset)
+{
+    return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(ring)+offset);
+}
+
+IoUring::~IoUring()
+{
+    if(bufRing!=nullptr)
+        munmap(bufRing,bufRingSize);
+    if(buffers!=nullptr)
+        munmap(buffers,buffersSize);
+    if(sqes!=nullptr)
+        munmap(sqes,sqesSize);
+    if(cqRing!=nullptr&&cqRing!=sqRing)
+        munmap(cqRing,cqRingSize);
+    if(sqRing!=nullptr)
+        munmap(sqRing,sqRingSize);
+    if(ringFd!=-1)
+        close(ringFd);
+}
+
+int IoUring::Setup(const unsigned entries)
+{
+    io_uring_params params={};
+    ringFd=io_uring_setup(entries,&params);
+    if(ringFd<0)
+    {
+        ringFd=-1;
+        return errno;
+    }
+    sqRingSize=params.sq_off.array+params.sq_entries*sizeof(unsigned);
+    cqRingSize=params.cq_off.cqes+params.cq_entries*sizeof(io_uring_cqe);
+    if((params.features&IORING_FEAT_SINGLE_MMAP)!=0)
+        sqRingSize=cqRingSize=sqRingSize>cqRingSize?sqRingSize:cqRingSize;
+    auto ptr=mmap(nullptr,sqRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ringFd,IORING_OFF_SQ_RING);
+    if(ptr==MAP_FAILED)
+        return errno;
+    sqRing=ptr;
+    if((params.features&IORING_FEAT_SINGLE_MMAP)!=0)
+        cqRing=sqRing;
+    else
+    {
+        ptr=mmap(nullptr,cqRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ringFd,IORING_OFF_CQ_RING);
+        if(ptr==MAP_FAILED)
+            return errno;
+        cqRing=ptr;
+    }
+    sqesSize=params.sq_entries*sizeof(io_uring_sqe);
+    ptr=mmap(nullptr,sqesSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ringFd,IORING_OFF_SQES);
+    if(ptr==MAP_FAILED)
+        return errno;
+    sqes=reinterpret_cast<io_uring_sqe*>(ptr);
+    sqHead=RingField<unsigned>(sqRing,params.sq_off.head);
+    sqTail=RingField<unsigned>(sqRing,params.sq_off.tail);
+    sqArray=RingField<unsigned>(sqRing,params.sq_off.array);
+    sqMask=*RingField<unsigned>(sqRing,params.sq_off.ring_mask);
+    sqEntries=params.sq_entries;
+    cqHead=RingField<unsigned>(cqRing,params.cq_off.head);
+    cqTail=RingField<unsigned>(cqRing,params.cq_off.tail);
+    cqMask=*RingField<unsigned>(cqRing,params.cq_off.ring_mask);
+    cqes=RingField<io_uring_cqe>(cqRing,params.cq_off.cqes);
+    return 0;
+}
+
+int IoUring::SetupBuffers(const uint16_t group, const unsigned count, const unsigned size)
+{
+    if(count<1||count>32768||(count&(count-1))!=0)
+        return EINVAL;
+    bufRingSize=count*sizeof(io_uring_buf);
+    auto ptr=mmap(nullptr,bufRingSize,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(ptr==MAP_FAILED)
+        return errno;
+    bufRing=reinterpret_cast<io_uring_buf_ring*>(ptr);
+    //ring memory must be touched before registration, kernel pins pages it is currently mapped to
+    std::memset(ptr,0,bufRingSize);
+    buffersSize=static_cast<size_t>(count)*size;
+    ptr=mmap(nullptr,buffersSize,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(ptr==MAP_FAILED)
+        return errno;
+    buffers=reinterpret_cast<unsigned char*>(ptr);
+    io_uring_buf_reg reg={};
+    reg.ring_addr=reinterpret_cast<uint64_t>(bufRing);
+    reg.ring_entries=count;
+    reg.bgid=group;
+    if(io_uring_register(ringFd,IORING_REGISTER_PBUF_RING,&reg,1)!=0)
+        return errno;
+    bufCount=count;
+    bufSize=size;
+    bufGroup=group;
+    bufTail=0;
+    for(unsigned i=0;i<count;++i)
+        RecycleBuffer(static_cast<uint16_t>(i));
+    return 0;
+}
+
+void IoUring::RecycleBuffer(const uint16_t bid)
+{
+    //ring entries are addressed directly: in C++ some kernel headers place flexible bufs array after the tail field
+    auto &buf=reinterpret_cast<io_uring_buf*>(bufRing)[bufTail&(bufCount-1)];
+    buf.addr=reinterpret_cast<uint64_t>(Buffer(bid));
+    buf.len=bufSize;
+    buf.bid=bid;
+    bufTail++;
+    __atomic_store_n(&bufRing->tail,bufTail,__ATOMIC_RELEASE);
+}
+
+io_uring_sqe* IoUring::GetSqe()
+{
+    auto tail=*sqTail+pending;
+    if(tail-__atomic_load_n(sqHead,__ATOMIC_ACQUIRE)>=sqEntries)
+        return nullptr;
+    auto idx=tail&sqMask;
+    auto sqe=&sqes[idx];
+    std::memset(sqe,0,sizeof(io_uring_sqe));
+    sqArray[idx]=idx;
+    pending++;
+    return sqe;
+}
+
+int IoUring::Submit(const unsigned waitNr)
+{
+    if(pending>0)
+    {
+        __atomic_store_n(sqTail,*sqTail+pending,__ATOMIC_RELEASE);
+        unsubmitted+=pending;
+        pending=0;
+    }
+    auto rv=io_uring_enter(ringFd,unsubmitted,waitNr,waitNr>0?IORING_ENTER_GETEVENTS:0);
+    if(rv<0)
+        return errno==EINTR?0:errno;
+    //sqes not consumed by kernel will be submitted with the next call
+    unsubmitted-=static_cast<unsigned>(rv)<unsubmitted?static_cast<unsigned>(rv):unsubmitted;
+    return 0;
+}
+
+unsigned IoUring::CqReady() const
+{
+    return __atomic_load_n(cqTail,__ATOMIC_ACQUIRE)-*cqHead;
+}
+
+const io_uring_cqe& IoUring::Cqe(const unsigned idx) const
+{
+    return cqes[(*cqHead+idx)&cqMask];
+}
+
+void IoUring::CqAdvance(const unsigned count)
+{
+    __atomic_store_n(cqHead,*cqHead+count,__ATOMIC_RELEASE);
+}
+
+#endif // HAVE_IO_URING
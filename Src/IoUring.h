@@ -0,0 +1,67 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#ifdef HAVE_IO_URING
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+//minimal io_uring wrapper on top of raw syscalls: submission and completion rings and single group of provided buffers.
+//not thread safe, must be used from one thread
+class IoUring
+{
+    private:
+        int ringFd=-1;
+        void *sqRing=nullptr;
+        size_t sqRingSize=0;
+        void *cqRing=nullptr;
+        size_t cqRingSize=0;
+        io_uring_sqe *sqes=nullptr;
+        size_t sqesSize=0;
+        unsigned *sqHead=nullptr;
+        unsigned *sqTail=nullptr;
+        unsigned *sqArray=nullptr;
+        unsigned sqMask=0;
+        unsigned sqEntries=0;
+        unsigned *cqHead=nullptr;
+        unsigned *cqTail=nullptr;
+        unsigned cqMask=0;
+        io_uring_cqe *cqes=nullptr;
+        unsigned pending=0; //sqes prepared but not yet added to the submission queue
+        unsigned unsubmitted=0; //sqes added to the submission queue but not yet consumed by kernel
+        //provided buffers ring
+        io_uring_buf_ring *bufRing=nullptr;
+        size_t bufRingSize=0;
+        unsigned char *buffers=nullptr;
+        size_t buffersSize=0;
+        unsigned bufCount=0;
+        unsigned bufSize=0;
+        uint16_t bufGroup=0;
+        uint16_t bufTail=0;
+    public:
+        IoUring() = default;
+        IoUring(const IoUring&) = delete;
+        IoUring& operator=(const IoUring&) = delete;
+        ~IoUring();
+        //create rings, returns 0 or errno
+        int Setup(const unsigned entries);
+        //register provided buffers group, count must be power of 2. returns 0 or errno
+        int SetupBuffers(const uint16_t group, const unsigned count, const unsigned size);
+        //get zeroed sqe for new request, nullptr if submission queue is full
+        io_uring_sqe* GetSqe();
+        //submit prepared sqes and wait for at least waitNr completions, returns 0 or errno
+        int Submit(const unsigned waitNr);
+        //completions available for processing, must be released with CqAdvance after processing
+        unsigned CqReady() const;
+        const io_uring_cqe& Cqe(const unsigned idx) const;
+        void CqAdvance(const unsigned count);
+        //provided buffers access
+        uint16_t BufferGroup() const { return bufGroup; }
+        const unsigned char* Buffer(const uint16_t bid) const { return buffers+static_cast<size_t>(bid)*bufSize; }
+        void RecycleBuffer(const uint16_t bid);
+};
+
+#endif // HAVE_IO_URING
+
+#endif // IOURING_H
@@ -0,0 +1,169 @@
+#ifndef LPMTABLE_H
+#define LPMTABLE_H
+
+#include "IPNetwork.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <memory>
+#include <utility>
+
+//longest-prefix-match table for ipv4 and ipv6 prefixes.
+//prefixes are kept in the multibit trie with 8-bit stride and leaf-pushing
+//(DIR-8-8-8-8 style for ipv4, 16 levels for ipv6), so lookup is at most 4 (or 16) array reads.
+//Insert() and Remove() update only the trie slots covered by the modified prefix.
+template <class T> class LPMTable
+{
+    public:
+        typedef std::pair<IPNetwork,T> Entry;
+    private:
+        static const uint32_t childFlag=0x80000000u;
+        static const uint32_t nodeSize=256;
+        std::map<IPNetwork,uint32_t> prefixes; //leaf for every prefix: index of its entry + 1
+        std::vector<std::unique_ptr<const Entry>> entries;
+        std::vector<uint32_t> freeLeaves; //leaves of removed prefixes, reused by next inserts
+        std::vector<uint32_t> nodes4;
+        std::vector<uint32_t> nodes6;
+
+        //node holding the slots of the prefix, missing nodes on the way are created
+        static uint32_t FindNode(std::vector<uint32_t> &nodes, const IPNetwork &prefix)
+        {
+            auto addr=reinterpret_cast<const unsigned char*>(prefix.ip.RawData());
+            if(nodes.empty())
+                nodes.resize(nodeSize,0);
+            uint32_t node=0;
+            for(int level=0,len=prefix.prefixLen;len>8;len-=8,++level)
+            {
+                auto pos=node*nodeSize+addr[level];
+                if((nodes[pos]&childFlag)==0)
+                {
+                    //push current leaf down to the new child node
+                    auto child=static_cast<uint32_t>(nodes.size()/nodeSize);
+                    nodes.resize(nodes.size()+nodeSize,nodes[pos]);
+                    nodes[pos]=child|childFlag;
+                }
+                node=nodes[pos]&~childFlag;
+            }
+            return node;
+        }
+
+        //for every slot of the prefix (and slots of its child nodes) replace leaves of less specific prefixes on insert,
+        //or the leaf of removed prefix on remove
+        void ReplaceLeaves(std::vector<uint32_t> &nodes, const uint32_t node, const uint32_t start, const uint32_t count, const int prefixLen, const uint32_t oldLeaf, const uint32_t leaf)
+        {
+            for(auto i=start;i<start+count;++i)
+            {
+                auto el=nodes[node*nodeSize+i];
+                if((el&childFlag)!=0)
+                    ReplaceLeaves(nodes,el&~childFlag,0,nodeSize,prefixLen,oldLeaf,leaf);
+                else if(oldLeaf>0?el==oldLeaf:(el==0||entries[el-1]->first.prefixLen<prefixLen))
+                    nodes[node*nodeSize+i]=leaf;
+            }
+        }
+
+        void UpdateTrie(const IPNetwork &prefix, const uint32_t oldLeaf, const uint32_t leaf)
+        {
+            auto &nodes=prefix.isV6?nodes6:nodes4;
+            auto node=FindNode(nodes,prefix);
+            auto level=prefix.prefixLen>0?(prefix.prefixLen-1)/8:0;
+            auto len=prefix.prefixLen-level*8;
+            auto addr=reinterpret_cast<const unsigned char*>(prefix.ip.RawData());
+            auto start=static_cast<uint32_t>(addr[level]&(0xFF<<(8-len)));
+            auto count=static_cast<uint32_t>(1<<(8-len));
+            ReplaceLeaves(nodes,node,start,count,prefix.prefixLen,oldLeaf,leaf);
+        }
+
+        //leaf of the longest prefix that covers given one, 0 if none
+        uint32_t CoveringLeaf(const IPNetwork &prefix) const
+        {
+            for(auto len=prefix.prefixLen;len>0;--len)
+            {
+                auto it=prefixes.find(IPNetwork(prefix.ip,len-1));
+                if(it!=prefixes.end())
+                    return it->second;
+            }
+            return 0;
+        }
+    public:
+        void Insert(const IPNetwork &prefix, const T &value)
+        {
+            if(!prefix.isValid)
+                return;
+            auto it=prefixes.find(prefix);
+            if(it!=prefixes.end())
+            {
+                //trie already points to the leaf of this prefix
+                entries[it->second-1].reset(new Entry(prefix,value));
+                return;
+            }
+            uint32_t leaf;
+            if(freeLeaves.empty())
+            {
+                entries.emplace_back(new Entry(prefix,value));
+                leaf=static_cast<uint32_t>(entries.size());
+            }
+            else
+            {
+                leaf=freeLeaves.back();
+                freeLeaves.pop_back();
+                entries[leaf-1].reset(new Entry(prefix,value));
+            }
+            prefixes.insert({prefix,leaf});
+            UpdateTrie(prefix,0,leaf);
+        }
+
+        bool Remove(const IPNetwork &prefix)
+        {
+            auto it=prefixes.find(prefix);
+            if(it==prefixes.end())
+                return false;
+            auto leaf=it->second;
+            prefixes.erase(it);
+            UpdateTrie(prefix,leaf,CoveringLeaf(prefix));
+            entries[leaf-1].reset();
+            freeLeaves.push_back(leaf);
+            return true;
+        }
+
+        void Clear()
+        {
+            prefixes.clear();
+            entries.clear();
+            freeLeaves.clear();
+            nodes4.clear();
+            nodes6.clear();
+        }
+
+        //exact match
+        const T* Find(const IPNetwork &prefix) const
+        {
+            auto it=prefixes.find(prefix);
+            return it==prefixes.end()?nullptr:&(entries[it->second-1]->second);
+        }
+
+        size_t Size() const { return prefixes.size(); }
+
+        //returned entry is valid until the prefix is removed or replaced
+        const Entry* Lookup(const IPAddress &ip) const
+        {
+            if(!ip.isValid)
+                return nullptr;
+            auto &nodes=ip.isV6?nodes6:nodes4;
+            if(nodes.empty())
+                return nullptr;
+            auto addr=reinterpret_cast<const unsigned char*>(ip.RawData());
+            auto len=ip.isV6?IPV6_ADDR_LEN:IPV4_ADDR_LEN;
+            uint32_t node=0;
+            for(auto level=0;level<len;++level)
+            {
+                auto el=nodes[node*nodeSize+addr[level]];
+                if((el&childFlag)==0)
+                    return el==0?nullptr:entries[el-1].get();
+                node=el&~childFlag;
+            }
+            return nullptr;
+        }
+};
+
+#endif // LPMTABLE_H
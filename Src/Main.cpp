@@ -6,17 +6,24 @@
 #include "StateSaver.h"
 #include "MessageBroker.h"
 #include "ShutdownHandler.h"
+#include "Reactor.h"
 
 #include <iostream>
 #include <thread>
 #include <chrono>
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
 #include <csignal>
 #include <string>
 #include <unordered_map>
+#include <fstream>
+#include <set>
+#include <vector>
+#include <memory>
 
 #include <sys/time.h>
+#include <sched.h>
 
 void usage(const std::string &self)
 {
@@ -25,6 +32,8 @@ void usage(const std::string &self)
     std::cerr<<"    -l <ip-addr> listen ip-address to receive protobuf-encoded DNS packages."<<std::endl;
     std::cerr<<"    -p <port-num> TCP port number to listen at."<<std::endl;
     std::cerr<<"    -i <if-name> network interface that will be used for routing."<<std::endl;
+    std::cerr<<"     comma-separated list of interfaces may be provided, ordered by preference:"<<std::endl;
+    std::cerr<<"     all routes will be moved to the next available interface on link failure"<<std::endl;
     std::cerr<<"  optional parameters:"<<std::endl;
     std::cerr<<"    -rp <route priority> metric/priority number for generated routes."<<std::endl;
     std::cerr<<"     100 by default. MUST NOT INTERFERE WITH ANY OTHER SYSTEM ROUTES"<<std::endl;
@@ -32,16 +41,101 @@ void usage(const std::string &self)
     std::cerr<<"     killswitch (blackhole) protective routes, rp+1 by default."<<std::endl;
     std::cerr<<"     MUST NOT INTERFERE WITH ANY OTHER ROUTES and must be higher than -rp"<<std::endl;
     std::cerr<<"    -gw4 <ip-addr> ipv4 gateway address. not used with p-t-p interfaces"<<std::endl;
+    std::cerr<<"     comma-separated list, matching interfaces from -i. may contain empty items"<<std::endl;
     std::cerr<<"    -gw6 <ip-addr> ipv6 gateway address. not used with p-t-p interfaces"<<std::endl;
+    std::cerr<<"     comma-separated list, matching interfaces from -i. may contain empty items"<<std::endl;
     std::cerr<<"    -ttl <seconds> additional time interval added to route expiration-time."<<std::endl;
-    std::cerr<<"    -mi <seconds> interval to run expired route management task, 5 by default."<<std::endl;
-    std::cerr<<"    -mp <percent> maximum percent of expired routes removed at once."<<std::endl;
+    std::cerr<<"    -tmin <seconds> minimum route lifetime, applied to dns ttl with extra ttl. 0 by default"<<std::endl;
+    std::cerr<<"    -tmax <seconds> maximum route lifetime, not limited by default"<<std::endl;
+    std::cerr<<"    -ta <percent> adaptive ttl: routes that were never re-resolved get only this share of"<<std::endl;
+    std::cerr<<"     extra ttl, re-resolved ones are kept for at least 3 average re-resolution intervals."<<std::endl;
+    std::cerr<<"     disabled by default"<<std::endl;
+    std::cerr<<"    -mi <seconds> interval between retries of pending route inserts, 5 by default."<<std::endl;
+    std::cerr<<"    -mb <ms> maximum time spent removing expired routes at once, 20 by default."<<std::endl;
+    std::cerr<<"     expired routes are removed on time, this only limits the duration of mass expirations"<<std::endl;
+    std::cerr<<"    -mp <percent> deprecated, use -mb. mapped to -mb of 4 ms per percent, ignored if -mb is set"<<std::endl;
     std::cerr<<"    -mr <retries> maximum retries when trying to install new route"<<std::endl;
-    std::cerr<<"  TODO: save and restore active routes to backup file for crash recovery"<<std::endl;
+    std::cerr<<"    -rs <count> number of route state shards, every shard has its own lock and"<<std::endl;
+    std::cerr<<"     management thread. 1 by default"<<std::endl;
+    std::cerr<<"    -pr <routes/s> maximum rate of routes pushed to kernel (new routes, retries and re-adds"<<std::endl;
+    std::cerr<<"     after link loss), so kernel routing lock is not held for too long. work above the rate"<<std::endl;
+    std::cerr<<"     is queued by priority, see -lw. new routes may exceed the rate by -pb routes, so short"<<std::endl;
+    std::cerr<<"     bursts of them are not delayed. refreshes are never delayed. not limited by default"<<std::endl;
+    std::cerr<<"    -pb <routes> burst size for -pr rate, equal to rate by default"<<std::endl;
+    std::cerr<<"    -pa <percent> auto-calibrate -pr rate from measured netlink request time, so route"<<std::endl;
+    std::cerr<<"     programming takes no more than this share of time. -pr is used as upper limit"<<std::endl;
+    std::cerr<<"    -lw <new,retry,refresh,reinstall> weights of route work lanes served when -pr rate is"<<std::endl;
+    std::cerr<<"     reached: new destinations, repeated requests for pending routes, refreshes of active"<<std::endl;
+    std::cerr<<"     routes and re-installs. 8,4,1,2 by default"<<std::endl;
+    std::cerr<<"    -lq <items> maximum queued route work per shard, when reached refreshes are dropped first,"<<std::endl;
+    std::cerr<<"     then re-installs and retries. 65536 by default"<<std::endl;
+    std::cerr<<"    -rx <routes> maximum managed routes (active and pending), divided evenly between shards."<<std::endl;
+    std::cerr<<"     route tables are preallocated, when the limit is reached old routes are evicted."<<std::endl;
+    std::cerr<<"     not limited by default"<<std::endl;
+    std::cerr<<"    -rv <lru|lfu> evict least recently or least frequently requested routes, lru by default"<<std::endl;
+    std::cerr<<"    -ra <percent> log alert when route count reaches this share of -rx limit, 90 by default"<<std::endl;
+    std::cerr<<"    -gr <file> graceful restart: route state is saved to this file on shutdown, the next process"<<std::endl;
+    std::cerr<<"     takes over routes left in kernel without re-adding them. profile name is appended"<<std::endl;
+    std::cerr<<"     to the file name when several profiles are used. disabled by default"<<std::endl;
+    std::cerr<<"    -st <1|0> single-threaded reactor mode: dns receiver, interface trackers and"<<std::endl;
+    std::cerr<<"     route management are served by one epoll loop instead of separate threads."<<std::endl;
+    std::cerr<<"     recommended for small routers with 1-2 cores, 0 by default"<<std::endl;
+    std::cerr<<"    -ur <1|0> receive dnsdist messages using io_uring with multishot receive,"<<std::endl;
+    std::cerr<<"     regular receive loop is used if not supported by kernel. 0 by default"<<std::endl;
+    std::cerr<<"    -rw <count> number of dns receiver workers, every worker has its own listen socket"<<std::endl;
+    std::cerr<<"     in SO_REUSEPORT group, so incoming connections are spread between them. 1 by default"<<std::endl;
+    std::cerr<<"    -rc <cpu list> comma-separated list of cpus to pin dns receiver workers to,"<<std::endl;
+    std::cerr<<"     matching workers from -rw. may contain empty items, not pinned by default"<<std::endl;
+    std::cerr<<"    -nb <KiB> netlink receive buffer size for interface trackers, SO_RCVBUFFORCE is used"<<std::endl;
+    std::cerr<<"     when permitted. on overflow the interface and route state is resynced. system default by default"<<std::endl;
+    std::cerr<<"    -pl4 <length> prefix length of routes generated from ipv4 answers, 32 by default"<<std::endl;
+    std::cerr<<"    -pl6 <length> prefix length of routes generated from ipv6 answers, 128 by default"<<std::endl;
+    std::cerr<<"    -sr <filename> file with static routes that never expire, one prefix per line"<<std::endl;
+    std::cerr<<"    -fc <1|0> skip routes for destinations already covered by existing routes"<<std::endl;
+    std::cerr<<"     via the same interface and gateway (or connected networks), 0 by default"<<std::endl;
+    std::cerr<<"    -nh <id> use kernel nexthop objects for generated routes, <id> is used for"<<std::endl;
+    std::cerr<<"     ipv4 nexthop group and <id>+1 for ipv6 nexthop group, next two ids for"<<std::endl;
+    std::cerr<<"     each interface are used for group members. gateway or interface change will"<<std::endl;
+    std::cerr<<"     update single nexthop group instead of every route. requires linux 5.3+"<<std::endl;
+    std::cerr<<"    -rm <metrics> kernel metrics for generated routes, comma-separated list of:"<<std::endl;
+    std::cerr<<"     initcwnd=<n>,initrwnd=<n>,mtu=<n>,advmss=<n>,quickack=<1|0>. not set by default"<<std::endl;
+    std::cerr<<"    -df <filename> domain filter file, one suffix per line. only answers for names"<<std::endl;
+    std::cerr<<"     matching these suffixes will produce routes. \"!suffix\" excludes names,"<<std::endl;
+    std::cerr<<"     most specific suffix wins, \".\" matches any name. all answers used by default"<<std::endl;
+    std::cerr<<"    -al <filename> allow list: only answers with addresses inside these prefixes"<<std::endl;
+    std::cerr<<"     will produce routes, one prefix per line. all addresses allowed by default"<<std::endl;
+    std::cerr<<"    -dl <filename> deny list: answers with addresses inside these prefixes never"<<std::endl;
+    std::cerr<<"     produce routes, one prefix per line. most specific prefix from both lists wins"<<std::endl;
+    std::cerr<<"    -dg <seconds> suppress repeated answers for the same address, if they would not"<<std::endl;
+    std::cerr<<"     move route expiration time by at least <seconds>. 0 (disabled) by default"<<std::endl;
+    std::cerr<<"    -c <filename> config file with routing profiles, every profile is a [name] section"<<std::endl;
+    std::cerr<<"     with its own domains and routing options: \"key=value\" lines, where key is one of"<<std::endl;
+    std::cerr<<"     i, gw4, gw6, rp, bp, ttl, pl4, pl6, sr, fc, nh, rm, df options without dash,"<<std::endl;
+    std::cerr<<"     or \"domains\" with comma-separated list of domain filter rules. these options"<<std::endl;
+    std::cerr<<"     from the command line are used as defaults for every profile."<<std::endl;
+    std::cerr<<"     rp, bp and nh values must be unique for every profile"<<std::endl;
+    std::cerr<<"  send SIGUSR1 to dump statistics to the log"<<std::endl;
+    std::cerr<<"  send SIGHUP to reload domain filter files and address allow/deny lists"<<std::endl;
+    std::cerr<<"  active routes are handed over on planned restart with -gr. crash recovery backup"<<std::endl;
+    std::cerr<<"  is not implemented yet, options below are reserved for it:"<<std::endl;
     std::cerr<<"    -fr <filename> file with backup of current routes, used for crash recover"<<std::endl;
     std::cerr<<"    -fi <seconds> approximate interval between attempting to perform save"<<std::endl;
 }
 
+std::vector<std::string> split_list(const std::string &value)
+{
+    std::vector<std::string> result;
+    size_t start=0;
+    while(true)
+    {
+        auto pos=value.find(',',start);
+        result.push_back(value.substr(start,pos==std::string::npos?std::string::npos:pos-start));
+        if(pos==std::string::npos)
+            return result;
+        start=pos+1;
+    }
+}
+
 int param_error(const std::string &self, const std::string &message)
 {
     std::cerr<<message<<std::endl;
@@ -49,17 +143,295 @@ int param_error(const std::string &self, const std::string &message)
     return 1;
 }
 
+//read non-empty lines from file, #-comments and leading/trailing whitespaces are removed
+bool read_lines(const std::string &filename, std::vector<std::string> &result)
+{
+    std::ifstream file(filename);
+    if(!file.is_open())
+        return false;
+    std::string line;
+    while(std::getline(file,line))
+    {
+        auto cPos=line.find('#');
+        if(cPos!=std::string::npos)
+            line.erase(cPos);
+        auto start=line.find_first_not_of(" \t\r");
+        if(start==std::string::npos)
+            continue;
+        auto end=line.find_last_not_of(" \t\r");
+        result.push_back(line.substr(start,end-start+1));
+    }
+    return !file.bad();
+}
+
+//read prefixes from file: one "ip-addr/prefix-len" record per line
+bool read_prefixes(const std::string &filename, std::set<IPNetwork> &result)
+{
+    std::vector<std::string> lines;
+    if(!read_lines(filename,lines))
+        return false;
+    for(auto const &line : lines)
+    {
+        IPNetwork prefix(line);
+        if(!prefix.isValid||prefix.prefixLen<1)
+        {
+            std::cerr<<"Invalid prefix: "<<line<<std::endl;
+            return false;
+        }
+        result.insert(prefix);
+    }
+    return true;
+}
+
+//settings of the routing profile: domains that will be routed via its own interfaces with its own metrics
+struct Profile
+{
+    std::string name;
+    std::vector<EgressPath> paths;
+    int metric;
+    int ksMetric;
+    int extraTTL;
+    int minLifetime;
+    int maxLifetime;
+    int oneOffShare;
+    int prefixLen4;
+    int prefixLen6;
+    std::set<IPNetwork> staticRoutes;
+    bool fibFilter;
+    uint32_t nhID;
+    std::string routeMetrics;
+    std::string filterFile;
+    std::vector<std::string> domains;
+};
+
+//read config file with profiles: "[name]" starts new profile section, "key=value" lines set profile options.
+//options are stored with leading dash, so they may be parsed the same way as command line
+bool read_config(const std::string &filename, std::vector<std::pair<std::string,std::unordered_map<std::string,std::string>>> &result)
+{
+    std::vector<std::string> lines;
+    if(!read_lines(filename,lines))
+        return false;
+    for(auto const &line : lines)
+    {
+        if(line.front()=='[')
+        {
+            if(line.back()!=']'||line.length()<3)
+            {
+                std::cerr<<"Invalid profile section: "<<line<<std::endl;
+                return false;
+            }
+            result.push_back({line.substr(1,line.length()-2),std::unordered_map<std::string,std::string>()});
+            continue;
+        }
+        auto pos=line.find('=');
+        if(result.empty()||pos==std::string::npos||pos==0)
+        {
+            std::cerr<<"Invalid config line: "<<line<<std::endl;
+            return false;
+        }
+        auto key=line.substr(0,line.find_last_not_of(" \t",pos-1)+1);
+        auto valStart=line.find_first_not_of(" \t",pos+1);
+        result.back().second["-"+key]=valStart==std::string::npos?"":line.substr(valStart);
+    }
+    return !result.empty();
+}
+
+//parse options of the single routing profile, returns 0 on success
+int parse_profile(const std::string &self, std::unordered_map<std::string,std::string> &args, Profile &profile)
+{
+    //parse interface name
+    if(args.find("-i")==args.end()||args["-i"].length()<1)
+        return param_error(self,"Target interface name is missing or invalid!");
+
+    //route priority
+    profile.metric=100;
+    if(args.find("-rp")!=args.end())
+    {
+        profile.metric=std::atoi(args["-rp"].c_str());
+        if(profile.metric<1)
+            return param_error(self,"Route priority value is invalid!");
+    }
+
+    //blackhole/killswitch route priority
+    profile.ksMetric=profile.metric+1;
+    if(args.find("-bp")!=args.end())
+    {
+        profile.ksMetric=std::atoi(args["-bp"].c_str());
+        if(profile.ksMetric<1)
+            return param_error(self,"Blackhole route priority value is invalid!");
+        if(profile.ksMetric<=profile.metric)
+            return param_error(self,"Blackhole route priority value must be > than regular route priority");
+    }
+
+    //interfaces and gateways
+    auto ifnames=split_list(args["-i"]);
+    auto gateways4=split_list(args.find("-gw4")!=args.end()?args["-gw4"]:"");
+    auto gateways6=split_list(args.find("-gw6")!=args.end()?args["-gw6"]:"");
+    if(gateways4.size()>ifnames.size())
+        return param_error(self,"Too many IPv4 gateways provided!");
+    if(gateways6.size()>ifnames.size())
+        return param_error(self,"Too many IPv6 gateways provided!");
+    for(size_t i=0;i<ifnames.size();++i)
+    {
+        if(ifnames[i].empty())
+            return param_error(self,"Target interface name is missing or invalid!");
+        for(size_t j=0;j<i;++j)
+            if(ifnames[j]==ifnames[i])
+                return param_error(self,"Target interface name is duplicated!");
+        auto gw4Str=i<gateways4.size()?gateways4[i]:"";
+        auto gw6Str=i<gateways6.size()?gateways6[i]:"";
+        if(!gw4Str.empty()&&(!IPAddress(gw4Str).isValid||IPAddress(gw4Str).isV6))
+            return param_error(self,"IPv4 gateway is invalid!");
+        if(!gw6Str.empty()&&(!IPAddress(gw6Str).isValid||!IPAddress(gw6Str).isV6))
+            return param_error(self,"IPv6 gateway is invalid!");
+        profile.paths.push_back(EgressPath(ifnames[i],gw4Str.empty()?IPAddress():IPAddress(gw4Str),gw6Str.empty()?IPAddress():IPAddress(gw6Str)));
+    }
+
+    //extra ttl
+    profile.extraTTL=60*150; //150 minutes - 2.5 houres
+    if(args.find("-ttl")!=args.end())
+    {
+        profile.extraTTL=std::atoi(args["-ttl"].c_str());
+        if(profile.extraTTL<1)
+            return param_error(self,"Extra protective TTL value is invalid!");
+    }
+
+    //route lifetime limits and adaptive ttl
+    profile.minLifetime=0;
+    if(args.find("-tmin")!=args.end())
+    {
+        profile.minLifetime=std::atoi(args["-tmin"].c_str());
+        if(profile.minLifetime<0||(profile.minLifetime==0&&args["-tmin"]!="0"))
+            return param_error(self,"Minimum route lifetime is invalid!");
+    }
+    profile.maxLifetime=0;
+    if(args.find("-tmax")!=args.end())
+    {
+        profile.maxLifetime=std::atoi(args["-tmax"].c_str());
+        if(profile.maxLifetime<1||profile.maxLifetime<profile.minLifetime)
+            return param_error(self,"Maximum route lifetime is invalid or less than minimum!");
+    }
+    profile.oneOffShare=0;
+    if(args.find("-ta")!=args.end())
+    {
+        profile.oneOffShare=std::atoi(args["-ta"].c_str());
+        if(profile.oneOffShare<1||profile.oneOffShare>100)
+            return param_error(self,"Adaptive TTL share is invalid!");
+    }
+
+    //prefix lengths for routes generated from dns answers
+    profile.prefixLen4=32;
+    if(args.find("-pl4")!=args.end())
+    {
+        profile.prefixLen4=std::atoi(args["-pl4"].c_str());
+        if(profile.prefixLen4<1||profile.prefixLen4>32)
+            return param_error(self,"IPv4 route prefix length is invalid");
+    }
+
+    profile.prefixLen6=128;
+    if(args.find("-pl6")!=args.end())
+    {
+        profile.prefixLen6=std::atoi(args["-pl6"].c_str());
+        if(profile.prefixLen6<1||profile.prefixLen6>128)
+            return param_error(self,"IPv6 route prefix length is invalid");
+    }
+
+    //static routes
+    if(args.find("-sr")!=args.end() && !read_prefixes(args["-sr"],profile.staticRoutes))
+        return param_error(self,"Failed to read static routes file");
+
+    //FIB-aware filter
+    profile.fibFilter=false;
+    if(args.find("-fc")!=args.end())
+    {
+        if(args["-fc"]!="0"&&args["-fc"]!="1")
+            return param_error(self,"FIB filter switch value is invalid");
+        profile.fibFilter=args["-fc"]=="1";
+    }
+
+    //nexthop objects
+    profile.nhID=0;
+    if(args.find("-nh")!=args.end())
+    {
+#ifdef HAVE_LINUX_NEXTHOP_H
+        auto nhVal=std::strtoul(args["-nh"].c_str(),nullptr,10);
+        if(nhVal<1||nhVal>UINT32_MAX-2-2*profile.paths.size())
+            return param_error(self,"Nexthop object id is invalid");
+        profile.nhID=static_cast<uint32_t>(nhVal);
+#else
+        return param_error(self,"Nexthop objects are not supported by this build");
+#endif
+    }
+
+    //kernel metrics for generated routes
+    profile.routeMetrics=args.find("-rm")!=args.end()?args["-rm"]:"";
+    if(!RouteMetrics(profile.routeMetrics).isValid)
+        return param_error(self,"Route metrics value is invalid");
+
+    //domain filter
+    profile.filterFile=args.find("-df")!=args.end()?args["-df"]:"";
+    if(args.find("-domains")!=args.end())
+        for(auto const &domain : split_list(args["-domains"]))
+        {
+            auto start=domain.find_first_not_of(" \t");
+            if(start!=std::string::npos)
+                profile.domains.push_back(domain.substr(start,domain.find_last_not_of(" \t")-start+1));
+        }
+    return 0;
+}
+
+//build domain filter from rules of all profiles, include rules are mapped to profile index
+std::shared_ptr<const DomainFilter> load_domain_filter(const std::vector<Profile> &profiles, ILogger &logger)
+{
+    std::vector<std::pair<std::string,int>> rules;
+    for(size_t i=0;i<profiles.size();++i)
+    {
+        std::vector<std::string> lines(profiles[i].domains);
+        if(!profiles[i].filterFile.empty() && !read_lines(profiles[i].filterFile,lines))
+        {
+            logger.Error()<<"Failed to read domain filter file: "<<profiles[i].filterFile<<std::endl;
+            return nullptr;
+        }
+        for(auto const &line : lines)
+            rules.push_back({line,static_cast<int>(i)});
+    }
+    std::shared_ptr<const DomainFilter> filter(new DomainFilter(rules));
+    if(!filter->IsValid())
+    {
+        logger.Error()<<"Failed to parse domain filter: "<<filter->GetError()<<std::endl;
+        return nullptr;
+    }
+    logger.Info()<<"Domain filter loaded with "<<filter->RuleCount()<<" rules"<<std::endl;
+    return filter;
+}
+
+//build destination address filter from allow and deny list files
+std::shared_ptr<const AddressFilter> load_address_filter(const std::string &allowFile, const std::string &denyFile, ILogger &logger)
+{
+    std::set<IPNetwork> allow;
+    std::set<IPNetwork> deny;
+    if(!allowFile.empty() && !read_prefixes(allowFile,allow))
+    {
+        logger.Error()<<"Failed to read address allow list: "<<allowFile<<std::endl;
+        return nullptr;
+    }
+    if(!denyFile.empty() && !read_prefixes(denyFile,deny))
+    {
+        logger.Error()<<"Failed to read address deny list: "<<denyFile<<std::endl;
+        return nullptr;
+    }
+    std::shared_ptr<const AddressFilter> filter(new AddressFilter(allow,deny));
+    logger.Info()<<"Address filter loaded with "<<filter->AllowCount()<<" allowed and "<<filter->DenyCount()<<" denied prefixes"<<std::endl;
+    return filter;
+}
+
 int main (int argc, char *argv[])
 {
-    //set timeouts used by background workers for network operations and some other events
-    //increasing this time will slow down reaction to some internal and external events
-    //decreasing this time too much will cause high cpu usage
+    //interval between retries of failed listen socket bind and between state saver runs.
+    //background workers do not poll for events, shutdown requests wake them immediately
     const int timeoutMs=500;
     const timeval timeoutTv={timeoutMs/1000,(timeoutMs-timeoutMs/1000*1000)*1000};
 
-    //timeout for main thread waiting for external signals
-    const timespec sigTs={2,0};
-
     std::unordered_map<std::string,std::string> args;
     bool isArgValue=false;
     for(auto i=1;i<argc;++i)
@@ -99,59 +471,53 @@ int main (int argc, char *argv[])
     if(port<1||port>65535)
         return param_error(argv[0],"TCP port number is invalid!");
 
-    //parse interface name
-    if(args.find("-i")==args.end()||args["-i"].length()<1)
-        return param_error(argv[0],"Target interface name is missing or invalid!");
-
-    //optional params
-
-    //route priority
-    int metric=100;
-    if(args.find("-rp")!=args.end())
+    //routing profiles
+    std::vector<Profile> profiles;
+    if(args.find("-c")!=args.end())
     {
-        metric=std::atoi(args["-rp"].c_str());
-        if(metric<1)
-            return param_error(argv[0],"Route priority value is invalid!");
-    }
-
-    //blackhole/killswitch route priority
-    int ksMetric=metric+1;
-    if(args.find("-bp")!=args.end())
-    {
-        ksMetric=std::atoi(args["-bp"].c_str());
-        if(ksMetric<1)
-            return param_error(argv[0],"Blackhole route priority value is invalid!");
-        if(ksMetric<=metric)
-            return param_error(argv[0],"Blackhole route priority value must be > than regular route priority");
-    }
-
-    //gateway4
-    bool gw4Set=false;
-    if(args.find("-gw4")!=args.end())
-    {
-        if(!IPAddress(args["-gw4"]).isValid||IPAddress(args["-gw4"]).isV6)
-            return param_error(argv[0],"IPv4 gateway is invalid!");
-        gw4Set=true;
-    }
-    const IPAddress gateway4=gw4Set?IPAddress(args["-gw4"]):IPAddress();
-
-    //gateway6
-    bool gw6Set=false;
-    if(args.find("-gw6")!=args.end())
-    {
-        if(!IPAddress(args["-gw6"]).isValid||!IPAddress(args["-gw6"]).isV6)
-            return param_error(argv[0],"IPv6 gateway is invalid!");
-        gw6Set=true;
+        std::vector<std::pair<std::string,std::unordered_map<std::string,std::string>>> sections;
+        if(!read_config(args["-c"],sections))
+            return param_error(argv[0],"Failed to read config file");
+        for(auto &section : sections)
+        {
+            //options from command line are used as defaults
+            auto profileArgs=args;
+            for(auto const &el : section.second)
+                profileArgs[el.first]=el.second;
+            Profile profile;
+            profile.name=section.first;
+            if(parse_profile(argv[0],profileArgs,profile)!=0)
+            {
+                std::cerr<<"Failed to parse profile: "<<section.first<<std::endl;
+                return 1;
+            }
+            if(profile.domains.empty()&&profile.filterFile.empty())
+                return param_error(argv[0],"No domains defined for profile: "+section.first);
+            profiles.push_back(profile);
+        }
+        //routes of every profile are distinguished by its metrics and nexthop ids
+        std::set<std::string> names;
+        std::set<int> metrics;
+        std::set<uint32_t> nhIDs;
+        for(auto const &profile : profiles)
+        {
+            if(!names.insert(profile.name).second)
+                return param_error(argv[0],"Profile name is duplicated: "+profile.name);
+            if(!metrics.insert(profile.metric).second||!metrics.insert(profile.ksMetric).second)
+                return param_error(argv[0],"Route priorities must be unique for every profile: "+profile.name);
+            for(uint32_t id=profile.nhID;profile.nhID>0&&id<profile.nhID+2+2*profile.paths.size();++id)
+                if(!nhIDs.insert(id).second)
+                    return param_error(argv[0],"Nexthop object ids must be unique for every profile: "+profile.name);
+        }
     }
-    const IPAddress gateway6=gw6Set?IPAddress(args["-gw6"]):IPAddress();
-
-    //route priority
-    int extraTTL=60*150; //150 minutes - 2.5 houres
-    if(args.find("-ttl")!=args.end())
+    else
     {
-        extraTTL=std::atoi(args["-ttl"].c_str());
-        if(extraTTL<1)
-            return param_error(argv[0],"Extra protective TTL value is invalid!");
+        Profile profile;
+        profile.name="default";
+        auto ec=parse_profile(argv[0],args,profile);
+        if(ec!=0)
+            return ec;
+        profiles.push_back(profile);
     }
 
     //management interval
@@ -163,13 +529,24 @@ int main (int argc, char *argv[])
             return param_error(argv[0],"Management interval time is invalid!");
     }
 
-    //management percent
-    int mgPercent=5;
+    //management time budget
+    int mgBudgetMs=20;
+    if(args.find("-mb")!=args.end())
+    {
+        mgBudgetMs=std::atoi(args["-mb"].c_str());
+        if(mgBudgetMs<1||mgBudgetMs>1000)
+            return param_error(argv[0],"Time budget for removing expired routes is invalid!");
+    }
+    //deprecated management percent, default 5% matches default 20 ms budget
+    bool mgPercentUsed=false;
     if(args.find("-mp")!=args.end())
     {
-        mgPercent=std::atoi(args["-mp"].c_str());
+        auto mgPercent=std::atoi(args["-mp"].c_str());
         if(mgPercent<1||mgPercent>100)
             return param_error(argv[0],"Percent of routes managed at once is invalid!");
+        mgPercentUsed=true;
+        if(args.find("-mb")==args.end())
+            mgBudgetMs=mgPercent*4;
     }
 
     //retry count
@@ -181,7 +558,151 @@ int main (int argc, char *argv[])
             return param_error(argv[0],"Route-add retry count is invalid");
     }
 
+    //route state shards
+    int shardCount=1;
+    if(args.find("-rs")!=args.end())
+    {
+        shardCount=std::atoi(args["-rs"].c_str());
+        if(shardCount<1||shardCount>256)
+            return param_error(argv[0],"Route state shards count is invalid");
+    }
+
+    //reactor mode
+    bool reactorMode=false;
+    if(args.find("-st")!=args.end())
+    {
+        if(args["-st"]!="0"&&args["-st"]!="1")
+            return param_error(argv[0],"Reactor mode value is invalid");
+        reactorMode=args["-st"]=="1";
+    }
+    if(reactorMode&&shardCount>1)
+        return param_error(argv[0],"Route state shards are not used in reactor mode");
+
+    //io_uring receive path
+    bool useUring=false;
+    if(args.find("-ur")!=args.end())
+    {
+        if(args["-ur"]!="0"&&args["-ur"]!="1")
+            return param_error(argv[0],"io_uring mode value is invalid");
+        useUring=args["-ur"]=="1";
+    }
+    if(reactorMode&&useUring)
+        return param_error(argv[0],"io_uring receive path is not used in reactor mode");
+
+    //dns receiver workers
+    int receiverCount=1;
+    if(args.find("-rw")!=args.end())
+    {
+        receiverCount=std::atoi(args["-rw"].c_str());
+        if(receiverCount<1||receiverCount>64)
+            return param_error(argv[0],"DNS receiver workers count is invalid");
+    }
+    if(reactorMode&&receiverCount>1)
+        return param_error(argv[0],"Multiple DNS receiver workers are not used in reactor mode");
+    std::vector<int> receiverCpus(static_cast<size_t>(receiverCount),-1);
+    if(args.find("-rc")!=args.end())
+    {
+        auto cpus=split_list(args["-rc"]);
+        if(cpus.size()>receiverCpus.size())
+            return param_error(argv[0],"Too many cpus provided for DNS receiver workers");
+        for(size_t i=0;i<cpus.size();++i)
+        {
+            if(cpus[i].empty())
+                continue;
+            receiverCpus[i]=std::atoi(cpus[i].c_str());
+            if(receiverCpus[i]<0||receiverCpus[i]>=CPU_SETSIZE||(receiverCpus[i]==0&&cpus[i]!="0"))
+                return param_error(argv[0],"DNS receiver worker cpu is invalid");
+        }
+    }
+
+    //pacing of route programming
+    int paceRate=0, paceBurst=0, paceShare=0;
+    if(args.find("-pr")!=args.end())
+    {
+        paceRate=std::atoi(args["-pr"].c_str());
+        if(paceRate<1)
+            return param_error(argv[0],"Route programming rate is invalid");
+    }
+    if(args.find("-pb")!=args.end())
+    {
+        paceBurst=std::atoi(args["-pb"].c_str());
+        if(paceBurst<1||paceRate<1)
+            return param_error(argv[0],"Route programming burst is invalid or rate is not set");
+    }
+    if(args.find("-pa")!=args.end())
+    {
+        paceShare=std::atoi(args["-pa"].c_str());
+        if(paceShare<1||paceShare>100||paceRate<1)
+            return param_error(argv[0],"Route programming time share is invalid or rate is not set");
+    }
+
+    //priority lanes of queued route work
+    std::vector<int> laneWeights={8,4,1,2};
+    if(args.find("-lw")!=args.end())
+    {
+        auto weights=split_list(args["-lw"]);
+        if(weights.size()!=laneWeights.size())
+            return param_error(argv[0],"Route work lane weights list is invalid");
+        for(size_t i=0;i<weights.size();++i)
+        {
+            laneWeights[i]=std::atoi(weights[i].c_str());
+            if(laneWeights[i]<1||laneWeights[i]>1000)
+                return param_error(argv[0],"Route work lane weight is invalid");
+        }
+    }
+    int laneLimit=65536;
+    if(args.find("-lq")!=args.end())
+    {
+        laneLimit=std::atoi(args["-lq"].c_str());
+        if(laneLimit<1)
+            return param_error(argv[0],"Route work queue limit is invalid");
+    }
+
+    //route limit and eviction
+    int maxRoutes=0;
+    if(args.find("-rx")!=args.end())
+    {
+        maxRoutes=std::atoi(args["-rx"].c_str());
+        if(maxRoutes<1)
+            return param_error(argv[0],"Route limit is invalid");
+    }
+    bool evictLFU=false;
+    if(args.find("-rv")!=args.end())
+    {
+        if((args["-rv"]!="lru"&&args["-rv"]!="lfu")||maxRoutes<1)
+            return param_error(argv[0],"Route eviction policy is invalid or route limit is not set");
+        evictLFU=args["-rv"]=="lfu";
+    }
+    int alertPct=90;
+    if(args.find("-ra")!=args.end())
+    {
+        alertPct=std::atoi(args["-ra"].c_str());
+        if(alertPct<1||alertPct>100||maxRoutes<1)
+            return param_error(argv[0],"Route limit alert level is invalid or route limit is not set");
+    }
+
+    //netlink receive buffer for interface trackers
+    int netlinkBufKb=0;
+    if(args.find("-nb")!=args.end())
+    {
+        netlinkBufKb=std::atoi(args["-nb"].c_str());
+        if(netlinkBufKb<64||netlinkBufKb>1048576)
+            return param_error(argv[0],"Netlink receive buffer size is invalid");
+    }
+
+    //deduplication granularity
+    int dedupGranularity=0;
+    if(args.find("-dg")!=args.end())
+    {
+        dedupGranularity=std::atoi(args["-dg"].c_str());
+        if(dedupGranularity<0||(dedupGranularity==0&&args["-dg"]!="0"))
+            return param_error(argv[0],"Deduplication granularity is invalid");
+    }
+
     std::string saveFile=args.find("-fr")!=args.end()?args["-fr"]:"";
+    std::string snapshotFile=args.find("-gr")!=args.end()?args["-gr"]:"";
+    if(args.find("-gr")!=args.end()&&snapshotFile.empty())
+        return param_error(argv[0],"Graceful restart snapshot file is invalid");
 
     int saveInterval=5;
     if(args.find("-fi")!=args.end())
@@ -191,34 +712,109 @@ int main (int argc, char *argv[])
             return param_error(argv[0],"Backup file save interval is incorrect");
     }
 
+    //destination address allow/deny lists
+    std::string allowFile=args.find("-al")!=args.end()?args["-al"]:"";
+    std::string denyFile=args.find("-dl")!=args.end()?args["-dl"]:"";
+    bool useAddrFilter=!allowFile.empty()||!denyFile.empty();
+
+    //use domain filter only if any rules provided, otherwise all answers are routed via the single profile
+    bool useFilter=false;
+    for(auto const &profile : profiles)
+        useFilter|=!profile.domains.empty()||!profile.filterFile.empty();
+
     StdioLoggerFactory logFactory;
     auto mainLogger=logFactory.CreateLogger("Main");
-    auto routingMgrLogger=logFactory.CreateLogger("RT_Man");
-    auto dnsReceiverLogger=logFactory.CreateLogger("DNS_Rc");
-    auto trackerLogger=logFactory.CreateLogger("ND_Trk");
+    std::vector<ILogger*> dnsReceiverLoggers;
+    for(int i=0;i<receiverCount;++i)
+        dnsReceiverLoggers.push_back(logFactory.CreateLogger(receiverCount>1?"DNS_R"+std::to_string(i):"DNS_Rc"));
+    std::vector<ILogger*> routingMgrLoggers;
+    std::vector<std::vector<ILogger*>> trackerLoggers;
+    for(auto const &profile : profiles)
+    {
+        auto suffix=profiles.size()>1?"_"+profile.name:"";
+        routingMgrLoggers.push_back(logFactory.CreateLogger(profiles.size()>1?"RT"+suffix:"RT_Man"));
+        trackerLoggers.push_back(std::vector<ILogger*>());
+        for(auto const &path : profile.paths)
+            trackerLoggers.back().push_back(logFactory.CreateLogger(profile.paths.size()>1?"ND"+suffix+"_"+path.ifname:(profiles.size()>1?"ND"+suffix:"ND_Trk")));
+    }
     auto saverLogger=logFactory.CreateLogger("ST_Svr");
-
+    auto reactorLogger=logFactory.CreateLogger("Reactr");
 
     //dump current configuration
     mainLogger->Info()<<"Starting up";
-    mainLogger->Info()<<"listening at "<<listenAddr<<" port "<<port<<"; routing via "<<args["-i"]<<" interface";
-    mainLogger->Info()<<"route prio: "<<metric<<"; blkhole-route prio: "<<ksMetric<<"; extra ttl: "<<extraTTL;
-    mainLogger->Info()<<"ipv4 gateway: "<<(gw4Set?gateway4.ToString():std::string("not set"))<<"; ipv6 gateway: "<<(gw6Set?gateway6.ToString():std::string("not set"));
-    mainLogger->Info()<<"management interval: "<<mgIntervalSec<<"; percent of routes to manage at once: "<<mgPercent<<"%; route-add max tries count: "<<addRetryCnt;
+    mainLogger->Info()<<"listening at "<<listenAddr<<" port "<<port<<"; profiles: "<<profiles.size();
+    mainLogger->Info()<<"retry interval: "<<mgIntervalSec<<"; expired routes removal budget: "<<mgBudgetMs<<" ms; route-add max tries count: "<<addRetryCnt<<"; route state shards: "<<shardCount<<"; reactor mode: "<<(reactorMode?"enabled":"disabled")<<"; io_uring receive: "<<(useUring?"enabled":"disabled")<<"; dns receiver workers: "<<receiverCount<<"; netlink receive buffer: "<<(netlinkBufKb>0?std::to_string(netlinkBufKb)+" KiB":std::string("default"));
+    if(mgPercentUsed)
+        mainLogger->Warning()<<"option -mp is deprecated, use -mb instead. expired routes removal budget: "<<mgBudgetMs<<" ms";
+    mainLogger->Info()<<"route programming rate: "<<(paceRate>0?std::to_string(paceRate)+" routes/s, burst "+std::to_string(paceBurst>0?paceBurst:paceRate)+(paceShare>0?", auto-calibrated to "+std::to_string(paceShare)+"% of time":std::string()):std::string("not limited"));
+    mainLogger->Info()<<"route limit: "<<(maxRoutes>0?std::to_string(maxRoutes)+" routes, "+(evictLFU?"lfu":"lru")+" eviction, alert at "+std::to_string(alertPct)+"%":std::string("not limited"));
+    mainLogger->Info()<<"route work lanes: weights new="<<laneWeights[0]<<", retry="<<laneWeights[1]<<", refresh="<<laneWeights[2]<<", reinstall="<<laneWeights[3]<<"; queue limit "<<laneLimit<<" per shard";
+    mainLogger->Info()<<"graceful restart snapshot: "<<(snapshotFile.empty()?std::string("disabled"):snapshotFile);
+    mainLogger->Info()<<"deduplication granularity: "<<(dedupGranularity>0?std::to_string(dedupGranularity)+" sec":std::string("disabled"));
+    for(auto const &profile : profiles)
+    {
+        mainLogger->Info()<<"profile "<<profile.name<<": routing via "<<profile.paths.size()<<" interface"<<(profile.paths.size()>1?"s":"")<<"; route prio: "<<profile.metric<<"; blkhole-route prio: "<<profile.ksMetric<<"; "<<TtlPolicy(static_cast<unsigned int>(profile.extraTTL),static_cast<unsigned int>(profile.minLifetime),static_cast<unsigned int>(profile.maxLifetime),static_cast<unsigned int>(profile.oneOffShare));
+        for(auto const &path : profile.paths)
+            mainLogger->Info()<<path.ifname<<" ipv4 gateway: "<<(path.gateway4.isValid?path.gateway4.ToString():std::string("not set"))<<"; ipv6 gateway: "<<(path.gateway6.isValid?path.gateway6.ToString():std::string("not set"));
+        mainLogger->Info()<<"ipv4 route prefix length: "<<profile.prefixLen4<<"; ipv6 route prefix length: "<<profile.prefixLen6<<"; static routes: "<<profile.staticRoutes.size()<<"; FIB filter: "<<(profile.fibFilter?"enabled":"disabled")<<"; nexthop id: "<<(profile.nhID>0?std::to_string(profile.nhID):std::string("not used"));
+        mainLogger->Info()<<"route metrics: "<<RouteMetrics(profile.routeMetrics)<<"; domain filter file: "<<(profile.filterFile.empty()?std::string("not used"):profile.filterFile)<<"; domains: "<<profile.domains.size();
+    }
+
+    //load domain filter
+    std::shared_ptr<const DomainFilter> domainFilter;
+    if(useFilter)
+    {
+        domainFilter=load_domain_filter(profiles,*mainLogger);
+        if(!domainFilter)
+            return 1;
+    }
+
+    //load address filter
+    std::shared_ptr<const AddressFilter> addressFilter;
+    if(useAddrFilter)
+    {
+        addressFilter=load_address_filter(allowFile,denyFile,*mainLogger);
+        if(!addressFilter)
+            return 1;
+    }
 
     //configure essential stuff
     MessageBroker messageBroker;
     ShutdownHandler shutdownHandler;
     messageBroker.AddSubscriber(shutdownHandler);
-
-    //create main worker-instances
-    RoutingManager routingMgr(*routingMgrLogger,args["-i"],gateway4,gateway6,extraTTL,mgIntervalSec,mgPercent,metric,ksMetric,addRetryCnt);
-    messageBroker.AddSubscriber(routingMgr);
-    DNSReceiver dnsReceiver(*dnsReceiverLogger,messageBroker,timeoutTv,listenAddr,port);
-    NetDevTracker tracker(*trackerLogger,messageBroker,args["-i"],timeoutTv,metric);
-    StateSaver saver(*saverLogger, saveFile, saveInterval, timeoutMs);
-    if(!saveFile.empty())
-        messageBroker.AddSubscriber(saver);
+    StateSaver saver(*saverLogger, saveFile, saveInterval);
+    Reactor reactor(*reactorLogger, messageBroker);
+
+    //create main worker-instances, every profile has its own message broker, so its workers are isolated from other profiles
+    std::vector<std::unique_ptr<MessageBroker>> profileBrokers;
+    std::vector<IMessageSender*> profileSenders;
+    std::vector<const IRouteState*> routeStates;
+    std::vector<std::unique_ptr<RoutingManager>> routingMgrs;
+    std::vector<std::unique_ptr<NetDevTracker>> trackers;
+    for(size_t p=0;p<profiles.size();++p)
+    {
+        auto const &profile=profiles[p];
+        profileBrokers.push_back(std::unique_ptr<MessageBroker>(new MessageBroker()));
+        auto &broker=*profileBrokers.back();
+        profileSenders.push_back(&broker);
+        broker.AddSubscriber(shutdownHandler);
+        routingMgrs.push_back(std::unique_ptr<RoutingManager>(new RoutingManager(*routingMgrLoggers[p],profile.paths,TtlPolicy(static_cast<unsigned int>(profile.extraTTL),static_cast<unsigned int>(profile.minLifetime),static_cast<unsigned int>(profile.maxLifetime),static_cast<unsigned int>(profile.oneOffShare)),mgIntervalSec,mgBudgetMs,profile.metric,profile.ksMetric,addRetryCnt,profile.prefixLen4,profile.prefixLen6,profile.staticRoutes,profile.fibFilter,profile.nhID,RouteMetrics(profile.routeMetrics),shardCount,paceRate,paceBurst,paceShare,laneWeights,laneLimit,maxRoutes,evictLFU,alertPct,snapshotFile.empty()||profiles.size()<2?snapshotFile:snapshotFile+"."+profile.name)));
+        broker.AddSubscriber(*routingMgrs.back());
+        routeStates.push_back(routingMgrs.back().get());
+        //one tracker per interface, first one is also reporting FIB updates and routes using nexthop objects
+        for(size_t i=0;i<profile.paths.size();++i)
+            trackers.push_back(std::unique_ptr<NetDevTracker>(new NetDevTracker(*trackerLoggers[p][i],broker,profile.paths[i].ifname,profile.metric,i==0?profile.nhID:0,i==0,netlinkBufKb*1024)));
+        if(!saveFile.empty())
+            broker.AddSubscriber(saver);
+    }
+    //every receiver worker has its own listen socket and decode state, route requests from all of them are merged by profile brokers
+    std::vector<std::unique_ptr<DNSReceiver>> dnsReceivers;
+    for(size_t i=0;i<dnsReceiverLoggers.size();++i)
+    {
+        dnsReceivers.push_back(std::unique_ptr<DNSReceiver>(new DNSReceiver(*dnsReceiverLoggers[i],messageBroker,profileSenders,routeStates,timeoutTv,listenAddr,port,static_cast<unsigned int>(dedupGranularity),useUring,receiverCpus[i])));
+        dnsReceivers.back()->SetDomainFilter(domainFilter);
+        dnsReceivers.back()->SetAddressFilter(addressFilter);
+    }
 
     //create sigset_t struct with signals
     sigset_t sigset;
@@ -230,22 +826,63 @@ int main (int argc, char *argv[])
     }
 
     //start background workers, or perform post-setup init
-    routingMgr.Startup();
-    dnsReceiver.Startup();
-    tracker.Startup();
+    if(reactorMode)
+    {
+        //failed components will request shutdown, so reactor is started only when all of them are ready
+        auto attached=true;
+        for(auto &routingMgr : routingMgrs)
+            attached=attached&&routingMgr->Attach(reactor);
+        for(auto &dnsReceiver : dnsReceivers)
+            attached=attached&&dnsReceiver->Attach(reactor);
+        for(auto &tracker : trackers)
+            attached=attached&&tracker->Attach(reactor);
+        if(attached)
+            reactor.Startup();
+    }
+    else
+    {
+        for(auto &routingMgr : routingMgrs)
+            routingMgr->Startup();
+        for(auto &dnsReceiver : dnsReceivers)
+            dnsReceiver->Startup();
+        for(auto &tracker : trackers)
+            tracker->Startup();
+    }
     if(!saveFile.empty())
         saver.Startup();
 
     while(true)
     {
-        auto signal=sigtimedwait(&sigset,nullptr,&sigTs);
-        auto error=errno;
-        if(signal<0 && error!=EAGAIN && error!=EINTR)
+        //block until signal arrives, shutdown requests from background workers are delivered as SIGUSR2
+        int signal=0;
+        auto error=sigwait(&sigset,&signal);
+        if(error!=0)
         {
             mainLogger->Error()<<"Error while handling incoming signal: "<<strerror(error)<<std::endl;
             break;
         }
-        else if(signal>0 && signal!=SIGUSR2 && signal!=SIGINT) //SIGUSR2 triggered by shutdownhandler to unblock sigtimedwait
+        else if(signal==SIGUSR1)
+        {
+            for(auto &dnsReceiver : dnsReceivers)
+                dnsReceiver->LogStats();
+            for(auto &routingMgr : routingMgrs)
+                routingMgr->LogStats();
+            for(auto &tracker : trackers)
+                tracker->LogStats();
+        }
+        else if(signal==SIGHUP && (useFilter||useAddrFilter))
+        {
+            //keep current filters on failure
+            auto newFilter=useFilter?load_domain_filter(profiles,*mainLogger):nullptr;
+            if(newFilter)
+                for(auto &dnsReceiver : dnsReceivers)
+                    dnsReceiver->SetDomainFilter(newFilter);
+            auto newAddrFilter=useAddrFilter?load_address_filter(allowFile,denyFile,*mainLogger):nullptr;
+            if(newAddrFilter)
+                for(auto &dnsReceiver : dnsReceivers)
+                    dnsReceiver->SetAddressFilter(newAddrFilter);
+        }
+        else if(signal>0 && signal!=SIGUSR2 && signal!=SIGINT) //SIGUSR2 triggered by shutdownhandler to unblock sigwait
         {
             mainLogger->Info()<< "Pending shutdown by receiving signal: "<<signal<<"->"<<strsignal(signal)<<std::endl;
             break;
@@ -261,26 +898,48 @@ int main (int argc, char *argv[])
         }
     }
 
+    //stop reactor first, components are detached only when it is not running
+    if(reactorMode)
+    {
+        reactor.Shutdown();
+        for(auto &dnsReceiver : dnsReceivers)
+            dnsReceiver->Detach();
+        for(auto &tracker : trackers)
+            tracker->Detach();
+        for(auto &routingMgr : routingMgrs)
+            routingMgr->Detach();
+    }
+
     //request shutdown of background workers
-    dnsReceiver.RequestShutdown();
-    tracker.RequestShutdown();
-    routingMgr.RequestShutdown();
+    for(auto &dnsReceiver : dnsReceivers)
+        dnsReceiver->RequestShutdown();
+    for(auto &tracker : trackers)
+        tracker->RequestShutdown();
+    for(auto &routingMgr : routingMgrs)
+        routingMgr->RequestShutdown();
     if(!saveFile.empty())
         saver.RequestShutdown();
 
     //wait for background workers shutdown complete
-    dnsReceiver.Shutdown();
-    tracker.Shutdown();
-    routingMgr.Shutdown();
+    for(auto &dnsReceiver : dnsReceivers)
+        dnsReceiver->Shutdown();
+    for(auto &tracker : trackers)
+        tracker->Shutdown();
+    for(auto &routingMgr : routingMgrs)
+        routingMgr->Shutdown();
     if(!saveFile.empty())
         saver.Shutdown();
 
+    logFactory.DestroyLogger(reactorLogger);
     logFactory.DestroyLogger(saverLogger);
-    logFactory.DestroyLogger(trackerLogger);
-    logFactory.DestroyLogger(dnsReceiverLogger);
-    logFactory.DestroyLogger(routingMgrLogger);
+    for(auto &profileLoggers : trackerLoggers)
+        for(auto trackerLogger : profileLoggers)
+            logFactory.DestroyLogger(trackerLogger);
+    for(auto routingMgrLogger : routingMgrLoggers)
+        logFactory.DestroyLogger(routingMgrLogger);
+    for(auto dnsReceiverLogger : dnsReceiverLoggers)
+        logFactory.DestroyLogger(dnsReceiverLogger);
     logFactory.DestroyLogger(mainLogger);
 
     return  0;
 }
-
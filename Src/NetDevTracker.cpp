@@ -1,5 +1,6 @@
 #include "NetDevTracker.h"
 #include "IPAddress.h"
+#include "IPNetwork.h"
 #include "InterfaceConfig.h"
 #include "ImmutableStorage.h"
 
@@ -9,27 +10,39 @@
 #include <cerrno>
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <net/if.h>
 #include <sys/time.h>
-#include <sys/select.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 
 class ShutdownMessage: public IShutdownMessage { public: ShutdownMessage(int _ec):IShutdownMessage(_ec){} };
-class NetDevUpdateMessage: public INetDevUpdateMessage { public: NetDevUpdateMessage(InterfaceConfig _config):INetDevUpdateMessage(_config){} };
-class RouteAddedMessage: public IRouteAddedMessage { public: RouteAddedMessage(const IPAddress &_ip):IRouteAddedMessage(_ip){} };
-class RouteRemovedMessage: public IRouteRemovedMessage { public: RouteRemovedMessage(const IPAddress &_ip):IRouteRemovedMessage(_ip){} };
+class NetDevUpdateMessage: public INetDevUpdateMessage { public: NetDevUpdateMessage(const std::string &_ifname, const InterfaceConfigPtr &_config, const uint64_t _timestamp):INetDevUpdateMessage(_ifname,_config,_timestamp){} };
+class RouteConfirmMessage: public IRouteConfirmMessage { public: RouteConfirmMessage(const std::vector<RouteConfirmation> &_confirmations):IRouteConfirmMessage(_confirmations){} };
+class RoutesResyncMessage: public IRoutesResyncMessage { public: RoutesResyncMessage(const std::string &_ifname):IRoutesResyncMessage(_ifname){} };
+class FibUpdateMessage: public IFibUpdateMessage { public: FibUpdateMessage(const IPNetwork &_dest, const unsigned int _ifIdx, const IPAddress &_gateway, const int _metric, const bool _isAdd):IFibUpdateMessage(_dest,_ifIdx,_gateway,_metric,_isAdd){} };
 
-NetDevTracker::NetDevTracker(ILogger &_logger, IMessageSender &_sender, const std::string &_ifname, const timeval _timeout, const int _metric):
+NetDevTracker::NetDevTracker(ILogger &_logger, IMessageSender &_sender, const std::string &_ifname, const int _metric, const uint32_t _nhID, const bool _reportFib, const int _rcvBufSize):
     ifname(_ifname),
-    timeout(_timeout),
     metric(_metric),
+    nhID(_nhID),
+    reportFib(_reportFib),
+    rcvBufSize(_rcvBufSize),
     logger(_logger),
-    sender(_sender)
+    sender(_sender),
+    config(std::make_shared<const InterfaceConfig>())
 {
     shutdownRequested.store(false);
+    overflowCount.store(0);
+    resyncCount.store(0);
+}
+
+void NetDevTracker::LogStats()
+{
+    logger.Info()<<"Netlink receive buffer overflows: "<<overflowCount.load()<<"; state resyncs: "<<resyncCount.load()<<std::endl;
 }
 
 void NetDevTracker::OnShutdown()
@@ -43,19 +56,25 @@ void NetDevTracker::HandleError(int ec, const char* message)
     sender.SendMessage(this,ShutdownMessage(ec));
 }
 
+static uint64_t GetTimestamp()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
 #define ISPTP(ifa) ((ifa->ifa_flags&IFF_POINTOPOINT)!=0)
-#define ISUP(ifa) ((ifa->ifa_flags&(IFF_UP|IFF_RUNNING))!=0)
+#define ISUP(ifa) ((ifa->ifa_flags&(IFF_UP|IFF_RUNNING))==(IFF_UP|IFF_RUNNING))
 #define ISBRC(ifa) ((ifa->ifa_flags&IFF_BROADCAST)!=0)
 
-void NetDevTracker::Worker()
+//open netlink socket, request routes dump and report initial interface state
+bool NetDevTracker::Open()
 {
     logger.Info()<<"Tracking network interface: "<<ifname<<std::endl;
 
-    auto sock=socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    sock=socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
     if(sock==-1)
     {
         HandleError(errno,"Failed to open netlink socket: ");
-        return;
+        return false;
     }
 
     sockaddr_nl nlAddr = {};
@@ -65,16 +84,61 @@ void NetDevTracker::Worker()
     if (bind(sock, reinterpret_cast<sockaddr*>(&nlAddr), sizeof(nlAddr)) == -1)
     {
         HandleError(errno,"Failed to bind to netlink socket: ");
-        return;
+        return false;
+    }
+
+    //route storms may produce more notifications than default receive buffer can hold, try to bypass rmem_max limit first
+    if(rcvBufSize>0 && setsockopt(sock,SOL_SOCKET,SO_RCVBUFFORCE,&rcvBufSize,sizeof(rcvBufSize))!=0)
+    {
+        logger.Warning()<<"Failed to force netlink receive buffer size, it will be limited by net.core.rmem_max: "<<strerror(errno)<<std::endl;
+        if(setsockopt(sock,SOL_SOCKET,SO_RCVBUF,&rcvBufSize,sizeof(rcvBufSize))!=0)
+        {
+            HandleError(errno,"Failed to set netlink receive buffer size: ");
+            return false;
+        }
     }
 
-    auto cfgStorage=ImmutableStorage<InterfaceConfig>(InterfaceConfig());
+    if(!RequestRoutesDump())
+        return false;
+    config=ReadInterfaceState();
+    if(!config)
+        return false;
+
+    logger.Info()<<"Initial interface state: "<<*config<<std::endl;
+    sender.SendMessage(this,NetDevUpdateMessage(ifname,config,GetTimestamp()));
+    return true;
+}
+
+//request dump of current routes, it will be processed by the main loop together with other notifications
+bool NetDevTracker::RequestRoutesDump()
+{
+    struct
+    {
+        nlmsghdr nl;
+        rtmsg rt;
+    } dumpReq = {};
+    dumpReq.nl.nlmsg_len=NLMSG_LENGTH(sizeof(rtmsg));
+    dumpReq.nl.nlmsg_type=RTM_GETROUTE;
+    dumpReq.nl.nlmsg_flags=NLM_F_REQUEST|NLM_F_DUMP;
+    dumpReq.rt.rtm_family=AF_UNSPEC;
+    if(send(sock,&dumpReq,dumpReq.nl.nlmsg_len,0)<0)
+    {
+        HandleError(errno,"Failed to request routes dump from netlink: ");
+        return false;
+    }
+    dumpPending=true;
+    return true;
+}
 
+//read current interface state with getifaddrs, returns nullptr on error
+InterfaceConfigPtr NetDevTracker::ReadInterfaceState()
+{
+    InterfaceConfigBuilder initial;
     ifaddrs *ifaddr=nullptr;
     if(getifaddrs(&ifaddr)!=0)
     {
         HandleError(errno,"Failed while executing getifaddrs: ");
-        return;
+        return nullptr;
     }
 
     bool ifFound=false;
@@ -93,15 +157,15 @@ void NetDevTracker::Worker()
         ifFound=true;
         //add local ip for interface
         IPAddress localIP(ifa->ifa_addr);
-        cfgStorage.Set(cfgStorage.Get().AddLocalIP(localIP));
+        initial.AddLocalIP(localIP);
 
         //set remote address - either broadcast or ptp
         if(!localIP.isV6)
         {
             if(ISPTP(ifa))
-                cfgStorage.Set(cfgStorage.Get().AddRemoteIP(IPAddress(ifa->ifa_dstaddr)));
+                initial.AddRemoteIP(IPAddress(ifa->ifa_dstaddr));
             else if(ISBRC(ifa))
-                cfgStorage.Set(cfgStorage.Get().AddRemoteIP(IPAddress(ifa->ifa_broadaddr)));
+                initial.AddRemoteIP(IPAddress(ifa->ifa_broadaddr));
         }
 
         //update interface flags
@@ -111,163 +175,309 @@ void NetDevTracker::Worker()
     isUP&=ifFound;
 
     freeifaddrs(ifaddr);
-    cfgStorage.Set(cfgStorage.Get().SetType(isPtP).SetState(isUP));
-
-    logger.Info()<<"Initial interface state: "<<cfgStorage.Get()<<std::endl;
-    sender.SendMessage(this,NetDevUpdateMessage(cfgStorage.Get()));
+    return initial.SetType(isPtP).SetState(isUP).Build();
+}
 
-    while(true)
+//notifications were lost: re-read interface state and request routes dump, so lost route-added confirmations are delivered again.
+//lost route-removed notifications cannot be replayed, so route state is reconciled with kernel when the dump is done
+bool NetDevTracker::Resync()
+{
+    //only one dump may run on the socket at a time, resync will be repeated when the current dump is done
+    if(dumpPending)
     {
-        //handle shutdown request
-        if(shutdownRequested.load())
-        {
-            logger.Info()<<"Shuting down NetDevTracker worker thread"<<std::endl;
-            break;
-        }
-
-        //wait for new data ready to be read from netlink
-        fd_set set;
-        FD_ZERO(&set);
-        FD_SET(sock, &set);
-        auto t = timeout;
-        auto rv = select(sock+1, &set, NULL, NULL, &t);
-        if(rv==0)
-            continue;
-        if(rv<0)
-        {
-            auto error=errno;
-            if(error==EINTR)//interrupted by signal
-                break;
-            HandleError(error,"Error awaiting message from netlink: ");
-            return;
-        }
+        resyncPending=true;
+        return true;
+    }
+    resyncPending=false;
+    resyncCount++;
+    if(!RequestRoutesDump())
+        return false;
+    resyncDump=true;
+    auto current=ReadInterfaceState();
+    if(!current)
+        return false;
+    if(!current->Equals(*config))
+    {
+        config=current;
+        logger.Info()<<"Interface state resynced: "<<*config<<std::endl;
+        sender.SendMessage(this,NetDevUpdateMessage(ifname,config,GetTimestamp()));
+    }
+    return true;
+}
 
-        cfgStorage.isUpdated=false;
+//read and process single batch of netlink messages, returns false on fatal error
+bool NetDevTracker::ProcessNetlink()
+{
+    confirmations.clear();
+    auto resyncDone=false;
+    auto eventTime=GetTimestamp();
+    //link and address changes from this read are applied to the single copy of interface state, created on first change
+    std::unique_ptr<InterfaceConfigBuilder> update;
+    auto Update=[&]() -> InterfaceConfigBuilder& {
+        if(!update)
+            update.reset(new InterfaceConfigBuilder(*config));
+        return *update;
+    };
 
-        //from man netlink.7
-        nlmsghdr buf[8192/sizeof(struct nlmsghdr)] = {};
-        iovec iov = { buf, sizeof(buf) };
-        sockaddr_nl sa = {};
-        msghdr msg = { &sa, sizeof(sa), &iov, 1, NULL, 0, 0 };
+    //from man netlink.7
+    nlmsghdr buf[8192/sizeof(struct nlmsghdr)] = {};
+    iovec iov = { buf, sizeof(buf) };
+    sockaddr_nl sa = {};
+    msghdr msg = { &sa, sizeof(sa), &iov, 1, NULL, 0, 0 };
 
-        //read message from netlink
-        auto len = recvmsg(sock, &msg, 0);
-        if(len<0)
+    //read message from netlink
+    auto len = recvmsg(sock, &msg, 0);
+    if(len<0)
+    {
+        auto error=errno;
+        if(error==EINTR||error==EAGAIN)//interrupted by signal or no data available
+            return true;
+        if(error==ENOBUFS)//receive buffer overflow, some notifications were dropped by kernel
         {
-            auto error=errno;
-            if(error==EINTR)//interrupted by signal
-                break;
-            HandleError(error,"Error reading message from netlink: ");
-            return;
+            overflowCount++;
+            logger.Warning()<<"Netlink receive buffer overflow, resyncing interface and routes state"<<std::endl;
+            return Resync();
         }
+        HandleError(error,"Error reading message from netlink: ");
+        return false;
+    }
 
-        //process message
-        for (auto *nh = reinterpret_cast<nlmsghdr*>(buf); NLMSG_OK (nh, len) && nh->nlmsg_type != NLMSG_DONE; nh = NLMSG_NEXT (nh, len))
+    //process message
+    for (auto *nh = reinterpret_cast<nlmsghdr*>(buf); NLMSG_OK (nh, len); nh = NLMSG_NEXT (nh, len))
+    {
+        //dump results may be inconsistent if routes were changed while dumping
+        if((nh->nlmsg_flags&NLM_F_DUMP_INTR)!=0)
+            resyncPending=true;
+        if (nh->nlmsg_type == NLMSG_DONE)
         {
-            if (nh->nlmsg_type == NLMSG_ERROR)
-            {
-                HandleError(errno,"Error received from netlink: ");
-                return;
-            }
-            else if (nh->nlmsg_type == RTM_NEWLINK || nh->nlmsg_type == RTM_DELLINK)
+            dumpPending=false;
+            //interrupted dump will be repeated, reconcile only after complete one
+            resyncDone=resyncDump&&!resyncPending;
+            if(resyncDone)
+                resyncDump=false;
+            break;
+        }
+        else if (nh->nlmsg_type == NLMSG_ERROR)
+        {
+            auto *err = reinterpret_cast<nlmsgerr*>(NLMSG_DATA(nh));
+            if(err->error==-EBUSY)//previous dump is still running, retry when it is done
             {
-                auto *ifl = reinterpret_cast<ifinfomsg*>(NLMSG_DATA(nh));
-                char msg_ifname[IFNAMSIZ]={};
-                if_indextoname(ifl->ifi_index, msg_ifname);
-                if(std::strncmp(ifname.c_str(),msg_ifname,IFNAMSIZ)!=0)
-                    continue; //interface name not matched
-                if(nh->nlmsg_type == RTM_DELLINK) //link disappeared, set state to false
-                    cfgStorage.Set(cfgStorage.Get().SetState(false)); //NOTE: TODO: maybe we also need to update interface type with SetType
-                else //network device was created or updated
-                    cfgStorage.Set(cfgStorage.Get().SetState((ifl->ifi_flags&(IFF_UP|IFF_RUNNING))!=0).SetType((ifl->ifi_flags&IFF_POINTOPOINT)!=0));
+                resyncPending=true;
+                continue;
             }
-            else if (nh->nlmsg_type == RTM_NEWADDR || nh->nlmsg_type == RTM_DELADDR)
+            HandleError(-err->error,"Error received from netlink: ");
+            return false;
+        }
+        else if (nh->nlmsg_type == RTM_NEWLINK || nh->nlmsg_type == RTM_DELLINK)
+        {
+            auto *ifl = reinterpret_cast<ifinfomsg*>(NLMSG_DATA(nh));
+            char msg_ifname[IFNAMSIZ]={};
+            if_indextoname(ifl->ifi_index, msg_ifname);
+            if(std::strncmp(ifname.c_str(),msg_ifname,IFNAMSIZ)!=0)
+                continue; //interface name not matched
+            if(nh->nlmsg_type == RTM_DELLINK) //link disappeared, set state to false
+                Update().SetState(false); //NOTE: TODO: maybe we also need to update interface type with SetType
+            else //network device was created or updated
+                Update().SetState((ifl->ifi_flags&(IFF_UP|IFF_RUNNING))==(IFF_UP|IFF_RUNNING)).SetType((ifl->ifi_flags&IFF_POINTOPOINT)!=0);
+        }
+        else if (nh->nlmsg_type == RTM_NEWADDR || nh->nlmsg_type == RTM_DELADDR)
+        {
+            auto *ifa = reinterpret_cast<ifaddrmsg*>(NLMSG_DATA(nh));
+            char msg_ifname[IFNAMSIZ]={};
+            if_indextoname(ifa->ifa_index, msg_ifname);
+            if(std::strncmp(ifname.c_str(),msg_ifname,IFNAMSIZ)!=0)
+                continue; //interface name not matched
+            auto rtl = IFA_PAYLOAD(nh);
+            for (auto *rth = IFA_RTA(ifa); RTA_OK(rth, rtl); rth = RTA_NEXT(rth, rtl))
             {
-                auto *ifa = reinterpret_cast<ifaddrmsg*>(NLMSG_DATA(nh));
-                char msg_ifname[IFNAMSIZ]={};
-                if_indextoname(ifa->ifa_index, msg_ifname);
-                if(std::strncmp(ifname.c_str(),msg_ifname,IFNAMSIZ)!=0)
-                    continue; //interface name not matched
-                auto rtl = IFA_PAYLOAD(nh);
-                for (auto *rth = IFA_RTA(ifa); RTA_OK(rth, rtl); rth = RTA_NEXT(rth, rtl))
+                if(rth->rta_type == IFA_LOCAL)
+                    nh->nlmsg_type==RTM_NEWADDR?Update().AddLocalIP(IPAddress(rth)):Update().DelLocalIP(IPAddress(rth));
+                else if(rth->rta_type == IFA_BROADCAST)
+                    nh->nlmsg_type==RTM_NEWADDR?Update().AddRemoteIP(IPAddress(rth)):Update().DelRemoteIP(IPAddress(rth));
+                else if(rth->rta_type == IFA_ADDRESS)
                 {
-                    auto config=cfgStorage.Get();
-                    if(rth->rta_type == IFA_LOCAL)
-                        cfgStorage.Set(nh->nlmsg_type==RTM_NEWADDR?config.AddLocalIP(IPAddress(rth)):config.DelLocalIP(IPAddress(rth)));
-                    else if(rth->rta_type == IFA_BROADCAST)
-                        cfgStorage.Set(nh->nlmsg_type==RTM_NEWADDR?config.AddRemoteIP(IPAddress(rth)):config.DelRemoteIP(IPAddress(rth)));
-                    else if(rth->rta_type == IFA_ADDRESS)
-                    {
-                        auto target=IPAddress(rth);
-                        if(target.isV6)
-                            cfgStorage.Set(nh->nlmsg_type==RTM_NEWADDR?config.AddLocalIP(target):config.DelLocalIP(target));
-                    }
+                    auto target=IPAddress(rth);
+                    if(target.isV6)
+                        nh->nlmsg_type==RTM_NEWADDR?Update().AddLocalIP(target):Update().DelLocalIP(target);
                 }
             }
-            else if (nh->nlmsg_type == RTM_NEWROUTE || nh->nlmsg_type == RTM_DELROUTE)
+        }
+        else if (nh->nlmsg_type == RTM_NEWROUTE || nh->nlmsg_type == RTM_DELROUTE)
+        {
+            auto *rtm = reinterpret_cast<rtmsg*>(NLMSG_DATA(nh));
+            //only unicast routes from main table will be qualified for further processing
+            if(rtm->rtm_family!=AF_INET&&rtm->rtm_family!=AF_INET6)
+                continue;
+            if(rtm->rtm_table!=RT_TABLE_MAIN)
+                continue;
+            if(rtm->rtm_type!=RTN_UNICAST)
+                continue;
+            //to identify route installed/removed by this program - we need to get following attributes
+            auto dest=ImmutableStorage<IPAddress>(IPAddress()); //destination ip address - valid ipv4 or ipv6 address
+            auto gateway=ImmutableStorage<IPAddress>(IPAddress()); //gateway, used for FIB updates
+            unsigned int rt_ifIdx=0;
+            char rt_ifname[IFNAMSIZ]={}; //interface (must match)
+            int rt_metric=-1; //metric/priority (must match)
+            bool rt_nhMatched=false; //route is using our nexthop object, may be used instead of interface
+            //process rtattr attributes
+            auto rtl = RTM_PAYLOAD(nh);
+            for (auto *rth = RTM_RTA(rtm); RTA_OK(rth, rtl); rth = RTA_NEXT(rth, rtl))
             {
-                auto *rtm = reinterpret_cast<rtmsg*>(NLMSG_DATA(nh));
-                //only routes with same paramerets as ours will be qualified for further processing
-                if(rtm->rtm_family!=AF_INET&&rtm->rtm_family!=AF_INET6)
-                    continue;
-                if(rtm->rtm_table!=RT_TABLE_MAIN)
-                    continue;
-                if(rtm->rtm_scope!=RT_SCOPE_UNIVERSE)
-                    continue;
-                if(rtm->rtm_protocol!=RTPROT_STATIC)
-                    continue;
-                if(rtm->rtm_type!=RTN_UNICAST)
-                    continue;
-                //to identify route installed/removed by this program - we need to get following attributes
-                auto dest=ImmutableStorage<IPAddress>(IPAddress()); //destination ip address - valid ipv4 or ipv6 address
-                char rt_ifname[IFNAMSIZ]={}; //interface (must match)
-                int rt_metric=-1; //metric/priority (must match)
-                //process rtattr attributes
-                auto rtl = RTM_PAYLOAD(nh);
-                for (auto *rth = RTM_RTA(rtm); RTA_OK(rth, rtl); rth = RTA_NEXT(rth, rtl))
-                {
-                    if(rth->rta_type==RTA_DST)
-                        dest.Set(IPAddress(rth));
-                    else if(rth->rta_type==RTA_OIF)
-                    {
-                        unsigned int ifIdx=0;
-                        memcpy(reinterpret_cast<void*>(&ifIdx),RTA_DATA(rth),sizeof(unsigned int));
-                        if(if_indextoname(ifIdx,rt_ifname)==nullptr)
-                            logger.Warning()<<"Failed to decode interface name while parsing route "<<(nh->nlmsg_type==RTM_NEWROUTE?"added":"removed")<<" notification:"<<strerror(errno)<<std::endl;
-                    }
-                    else if(rth->rta_type==RTA_PRIORITY)
-                        memcpy(reinterpret_cast<void*>(&rt_metric),RTA_DATA(rth),sizeof(int));
-                }
-                if(metric!=rt_metric||std::strncmp(ifname.c_str(),rt_ifname,IFNAMSIZ)!=0)
+                if(rth->rta_type==RTA_DST)
+                    dest.Set(IPAddress(rth));
+                else if(rth->rta_type==RTA_GATEWAY)
+                    gateway.Set(IPAddress(rth));
+                else if(rth->rta_type==RTA_OIF)
                 {
-                    //logger.Warning()<<"*** Do not process route "<<(nh->nlmsg_type==RTM_NEWROUTE?"ADD":"REMOVE")<<" with metric/prio: "<<metric<<"; ip:"<<dest.Get()<<"; iface: "<<rt_ifname;
-                    continue; //metric/priority or interface name not matched
+                    memcpy(reinterpret_cast<void*>(&rt_ifIdx),RTA_DATA(rth),sizeof(unsigned int));
+                    if(if_indextoname(rt_ifIdx,rt_ifname)==nullptr)
+                        logger.Warning()<<"Failed to decode interface name while parsing route "<<(nh->nlmsg_type==RTM_NEWROUTE?"added":"removed")<<" notification:"<<strerror(errno)<<std::endl;
                 }
-                if(!dest.Get().isValid)
+                else if(rth->rta_type==RTA_PRIORITY)
+                    memcpy(reinterpret_cast<void*>(&rt_metric),RTA_DATA(rth),sizeof(int));
+#ifdef HAVE_LINUX_NEXTHOP_H
+                else if(rth->rta_type==RTA_NH_ID && nhID>0)
                 {
-                    logger.Warning()<<"No valid destination address received for route "<<(nh->nlmsg_type==RTM_NEWROUTE?"ADD":"REMOVE")<<" notification"<<std::endl;
-                    continue;
+                    uint32_t rt_nhID=0;
+                    memcpy(reinterpret_cast<void*>(&rt_nhID),RTA_DATA(rth),sizeof(uint32_t));
+                    rt_nhMatched=rt_nhID==nhID||rt_nhID==nhID+1;
                 }
-                //logger.Info()<<"Route "<<(nh->nlmsg_type==RTM_NEWROUTE?"added":"removed")<<"; ip="<<dest.Get()<<std::endl;
-                if(nh->nlmsg_type==RTM_NEWROUTE)
-                    sender.SendMessage(this,RouteAddedMessage(dest.Get()));
-                else
-                    sender.SendMessage(this,RouteRemovedMessage(dest.Get()));
+#endif
+            }
+            //default route comes without destination attribute
+            if(!dest.Get().isValid&&rtm->rtm_dst_len==0)
+            {
+                const unsigned char zero[IP_ADDR_LEN]={};
+                dest.Set(IPAddress(zero,rtm->rtm_family==AF_INET6?IPV6_ADDR_LEN:IPV4_ADDR_LEN));
+            }
+            //routes installed by this program are static universe-scoped routes with our metric
+            if(rtm->rtm_scope!=RT_SCOPE_UNIVERSE||rtm->rtm_protocol!=RTPROT_STATIC||metric!=rt_metric)
+            {
+                //report all other routes as FIB updates
+                const IPNetwork fibNet(dest.Get(),rtm->rtm_dst_len);
+                if(reportFib && fibNet.isValid)
+                    sender.SendMessage(this,FibUpdateMessage(fibNet,rt_ifIdx,gateway.Get(),rt_metric,nh->nlmsg_type==RTM_NEWROUTE));
+                continue;
+            }
+            //only routes via tracked interface or our nexthop object (when interface is not reported) are processed
+            if(rt_ifname[0]=='\0'?!rt_nhMatched:std::strncmp(ifname.c_str(),rt_ifname,IFNAMSIZ)!=0)
+            {
+                //logger.Warning()<<"*** Do not process route "<<(nh->nlmsg_type==RTM_NEWROUTE?"ADD":"REMOVE")<<" with metric/prio: "<<metric<<"; ip:"<<dest.Get()<<"; iface: "<<rt_ifname;
+                continue; //interface name not matched
+            }
+            if(!dest.Get().isValid)
+            {
+                logger.Warning()<<"No valid destination address received for route "<<(nh->nlmsg_type==RTM_NEWROUTE?"ADD":"REMOVE")<<" notification"<<std::endl;
+                continue;
+            }
+            //destination network - ip address with prefix length from route header
+            const IPNetwork destNet(dest.Get(),rtm->rtm_dst_len);
+            if(!destNet.isValid)
+            {
+                logger.Warning()<<"Invalid destination prefix length "<<static_cast<int>(rtm->rtm_dst_len)<<" received for route "<<(nh->nlmsg_type==RTM_NEWROUTE?"ADD":"REMOVE")<<" notification"<<std::endl;
+                continue;
             }
-            else logger.Warning()<<"Unknown message received: "<<nh->nlmsg_type<<std::endl; //TODO: decode other messages
+            //logger.Info()<<"Route "<<(nh->nlmsg_type==RTM_NEWROUTE?"added":"removed")<<"; dest="<<destNet<<std::endl;
+            confirmations.emplace_back(destNet,std::string(rt_ifname),nh->nlmsg_type==RTM_NEWROUTE);
         }
+        else logger.Warning()<<"Unknown message received: "<<nh->nlmsg_type<<std::endl; //TODO: decode other messages
+    }
 
-        if(cfgStorage.isUpdated)
-        {
-            auto config=cfgStorage.Get();
-            logger.Info()<<"Interface state updated: "<<config<<std::endl;
-            sender.SendMessage(this,NetDevUpdateMessage(config));
-        }
+    //all route notifications from this read are delivered at once
+    if(!confirmations.empty())
+        sender.SendMessage(this,RouteConfirmMessage(confirmations));
+
+    //new snapshot is published only if interface state was actually changed
+    if(update&&update->isUpdated)
+    {
+        config=update->Build();
+        logger.Info()<<"Interface state updated: "<<*config<<std::endl;
+        sender.SendMessage(this,NetDevUpdateMessage(ifname,config,eventTime));
     }
 
-    if(close(sock)!=0)
+    //sent after confirmations from the dump, so routes added meanwhile are already active
+    if(resyncDone)
+        sender.SendMessage(this,RoutesResyncMessage(ifname));
+
+    if(resyncPending&&!dumpPending)
+        return Resync();
+    return true;
+}
+
+bool NetDevTracker::Close()
+{
+    if(sock==-1)
+        return true;
+    auto result=close(sock);
+    sock=-1;
+    if(result!=0)
     {
         HandleError(errno,"Failed to close netlink socket: ");
+        return false;
+    }
+    return true;
+}
+
+void NetDevTracker::Worker()
+{
+    if(!Open())
         return;
+
+    while(true)
+    {
+        //handle shutdown request
+        if(shutdownRequested.load())
+        {
+            logger.Info()<<"Shuting down NetDevTracker worker thread"<<std::endl;
+            break;
+        }
+
+        //wait for new data ready to be read from netlink, or for shutdown request
+        pollfd fds[2]={{sock,POLLIN,0},{GetWakeupFd(),POLLIN,0}};
+        auto rv = poll(fds, 2, -1);
+        if(rv==0||(rv>0&&fds[0].revents==0))
+            continue;
+        if(rv<0)
+        {
+            auto error=errno;
+            if(error==EINTR)//interrupted by signal
+                break;
+            HandleError(error,"Error awaiting message from netlink: ");
+            return;
+        }
+
+        if(!ProcessNetlink())
+            return;
+    }
+
+    Close();
+}
+
+bool NetDevTracker::Attach(Reactor &_reactor)
+{
+    if(!Open())
+        return false;
+    if(fcntl(sock,F_SETFL,fcntl(sock,F_GETFL)|O_NONBLOCK)!=0)
+    {
+        HandleError(errno,"Failed to set non-blocking mode for netlink socket: ");
+        return false;
     }
+    reactor=&_reactor;
+    return reactor->Add(sock,*this);
+}
+
+void NetDevTracker::Detach()
+{
+    if(reactor==nullptr)
+        return;
+    reactor->Remove(sock);
+    reactor=nullptr;
+    logger.Info()<<"Detaching NetDevTracker from reactor"<<std::endl;
+    Close();
+}
+
+void NetDevTracker::OnReactorEvent(const int, const uint32_t)
+{
+    if(!ProcessNetlink())
+        reactor->Remove(sock);
 }
@@ -4,26 +4,53 @@
 #include "WorkerBase.h"
 #include "ILogger.h"
 #include "IMessageSender.h"
+#include "IReactorHandler.h"
+#include "Reactor.h"
+#include "InterfaceConfig.h"
 
 #include <atomic>
-#include <sys/time.h>
+#include <cstdint>
+#include <vector>
 
-class NetDevTracker final : public WorkerBase
+class NetDevTracker final : public WorkerBase, public IReactorHandler
 {
     private:
         const std::string ifname;
-        const timeval timeout;
         const int metric;
+        const uint32_t nhID;
+        const bool reportFib;
+        const int rcvBufSize; //netlink receive buffer size, system default if 0
         ILogger &logger;
         IMessageSender &sender;
         std::atomic<bool> shutdownRequested;
+        InterfaceConfigPtr config; //last published interface state
+        int sock=-1;
+        Reactor *reactor=nullptr;
+        std::vector<RouteConfirmation> confirmations; //route notifications collected from the current netlink read
+        bool dumpPending=false; //routes dump is in progress, new dump can be requested only after it is done
+        bool resyncPending=false; //overflow happened during routes dump, resync again when it is done
+        bool resyncDump=false; //current routes dump was requested by resync, route state is reconciled when it is done
+        std::atomic<uint64_t> overflowCount;
+        std::atomic<uint64_t> resyncCount;
 
         void HandleError(int ec, const char* message);
+        bool Open();
+        bool RequestRoutesDump();
+        InterfaceConfigPtr ReadInterfaceState();
+        bool Resync();
+        bool ProcessNetlink();
+        bool Close();
         //methods for WorkerBase
         void Worker() final;
         void OnShutdown() final;
     public:
-        NetDevTracker(ILogger &logger, IMessageSender &sender, const std::string &ifname, const timeval timeout, const int metric);
+        NetDevTracker(ILogger &logger, IMessageSender &sender, const std::string &ifname, const int metric, const uint32_t nhID, const bool reportFib, const int rcvBufSize);
+        void LogStats();
+        //reactor mode, used instead of Startup/Shutdown
+        bool Attach(Reactor &reactor);
+        void Detach();
+        //IReactorHandler
+        void OnReactorEvent(const int fd, const uint32_t events) final;
 };
 
 #endif // NETDEVTRACKER_H
@@ -0,0 +1,94 @@
+#include "Reactor.h"
+
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+
+//maximum number of events processed by single epoll_wait call
+#define REACTOR_MAX_EVENTS 64
+
+class ShutdownMessage: public IShutdownMessage { public: ShutdownMessage(int _ec):IShutdownMessage(_ec){} };
+
+Reactor::Reactor(ILogger &_logger, IMessageSender &_sender):
+    logger(_logger),
+    sender(_sender)
+{
+    shutdownPending.store(false);
+    epollFd=epoll_create1(EPOLL_CLOEXEC);
+}
+
+Reactor::~Reactor()
+{
+    if(epollFd!=-1)
+        close(epollFd);
+}
+
+void Reactor::HandleError(int ec, const char* message)
+{
+    logger.Error()<<message<<strerror(ec)<<std::endl;
+    sender.SendMessage(this,ShutdownMessage(ec));
+}
+
+bool Reactor::Add(const int fd, IReactorHandler &handler)
+{
+    epoll_event ev={};
+    ev.events=EPOLLIN;
+    ev.data.fd=fd;
+    if(epollFd==-1||epoll_ctl(epollFd,EPOLL_CTL_ADD,fd,&ev)!=0)
+    {
+        logger.Error()<<"Failed to add descriptor to epoll: "<<strerror(errno)<<std::endl;
+        return false;
+    }
+    handlers[fd]=&handler;
+    return true;
+}
+
+bool Reactor::Remove(const int fd)
+{
+    if(handlers.erase(fd)<1)
+        return false;
+    if(epoll_ctl(epollFd,EPOLL_CTL_DEL,fd,nullptr)!=0)
+        logger.Warning()<<"Failed to remove descriptor from epoll: "<<strerror(errno)<<std::endl;
+    return true;
+}
+
+void Reactor::OnShutdown()
+{
+    shutdownPending.store(true);
+}
+
+void Reactor::Worker()
+{
+    logger.Info()<<"Starting reactor with "<<handlers.size()<<" descriptors"<<std::endl;
+    epoll_event ev={};
+    ev.events=EPOLLIN;
+    ev.data.fd=GetWakeupFd();
+    if(epollFd==-1||epoll_ctl(epollFd,EPOLL_CTL_ADD,ev.data.fd,&ev)!=0)
+    {
+        HandleError(epollFd==-1?EBADF:errno,"Failed to setup epoll: ");
+        return;
+    }
+
+    epoll_event events[REACTOR_MAX_EVENTS];
+    while(!shutdownPending.load())
+    {
+        auto count=epoll_wait(epollFd,events,REACTOR_MAX_EVENTS,-1);
+        if(count<0)
+        {
+            if(errno==EINTR)
+                continue;
+            HandleError(errno,"Error awaiting events: ");
+            return;
+        }
+        for(auto i=0;i<count&&!shutdownPending.load();++i)
+        {
+            //descriptor may be removed by handler of previous event
+            auto it=handlers.find(events[i].data.fd);
+            if(it!=handlers.end())
+                it->second->OnReactorEvent(events[i].data.fd,events[i].events);
+        }
+    }
+    logger.Info()<<"Shuting down reactor"<<std::endl;
+}
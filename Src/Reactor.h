@@ -0,0 +1,34 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "ILogger.h"
+#include "IMessageSender.h"
+#include "IReactorHandler.h"
+#include "WorkerBase.h"
+
+#include <atomic>
+#include <unordered_map>
+
+//single-threaded epoll loop, used instead of separate worker threads in reactor mode.
+//handlers are invoked only from the reactor thread, so components attached to the same reactor need no extra synchronization between them.
+//Add and Remove must be called before Startup or from the reactor thread
+class Reactor final : public WorkerBase
+{
+    private:
+        ILogger &logger;
+        IMessageSender &sender;
+        std::atomic<bool> shutdownPending;
+        int epollFd;
+        std::unordered_map<int,IReactorHandler*> handlers;
+        void HandleError(int ec, const char* message);
+        //methods for WorkerBase
+        void Worker() final;
+        void OnShutdown() final;
+    public:
+        Reactor(ILogger &logger, IMessageSender &sender);
+        ~Reactor();
+        bool Add(const int fd, IReactorHandler &handler);
+        bool Remove(const int fd);
+};
+
+#endif // REACTOR_H
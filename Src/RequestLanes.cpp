@@ -0,0 +1,86 @@
+#include "RequestLanes.h"
+
+//lanes that may be shed to make room for incoming item, in order of shedding
+static const RequestLane shedOrder[]={LANE_REFRESH,LANE_REINSTALL,LANE_RETRY};
+
+RequestLanes::RequestLanes():
+    limit(SIZE_MAX)
+{
+}
+
+void RequestLanes::Configure(const std::vector<int> &weights, const size_t _limit)
+{
+    for(size_t i=0;i<LANE_COUNT;++i)
+        lanes[i].weight=i<weights.size()&&weights[i]>0?static_cast<uint64_t>(weights[i]):1;
+    limit=_limit<1?1:_limit;
+}
+
+//drop the newest item from the lowest class that is less important than incoming one
+bool RequestLanes::MakeRoom(const RequestLane incoming)
+{
+    for(auto victim : shedOrder)
+    {
+        if(victim==incoming)
+            return false;
+        auto &lane=lanes[victim];
+        if(lane.items.empty())
+            continue;
+        lane.items.pop_back();
+        lane.shed++;
+        total--;
+        return true;
+    }
+    return false;
+}
+
+bool RequestLanes::Push(const RequestLane lane, const LaneItem &item)
+{
+    if(total>=limit&&!MakeRoom(lane))
+    {
+        lanes[lane].shed++;
+        return false;
+    }
+    lanes[lane].items.push_back(item);
+    total++;
+    return true;
+}
+
+bool RequestLanes::HasItems(const unsigned mask) const
+{
+    for(size_t i=0;i<LANE_COUNT;++i)
+        if((mask&(1u<<i))!=0&&!lanes[i].items.empty())
+            return true;
+    return false;
+}
+
+LaneItem RequestLanes::Pop(RequestLane &result, const unsigned mask, const uint64_t now)
+{
+    while((mask&(1u<<cur))==0||lanes[cur].items.empty()||lanes[cur].deficit<1)
+    {
+        //idle lane does not accumulate deficit, lane that is not selected keeps it until the next round
+        if(lanes[cur].items.empty())
+            lanes[cur].deficit=0;
+        cur=(cur+1)%LANE_COUNT;
+        if((mask&(1u<<cur))!=0&&!lanes[cur].items.empty())
+            lanes[cur].deficit+=lanes[cur].weight;
+    }
+    auto &lane=lanes[cur];
+    LaneItem item(lane.items.front());
+    lane.items.pop_front();
+    lane.deficit--;
+    lane.served++;
+    total--;
+    auto wait=now>item.queuedAt?now-item.queuedAt:0;
+    lane.waitSum+=wait;
+    if(wait>lane.waitMax)
+        lane.waitMax=wait;
+    result=static_cast<RequestLane>(cur);
+    return item;
+}
+
+void RequestLanes::Clear(const RequestLane lane)
+{
+    total-=lanes[lane].items.size();
+    lanes[lane].items.clear();
+    lanes[lane].deficit=0;
+}
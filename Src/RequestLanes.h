@@ -0,0 +1,68 @@
+#ifndef REQUESTLANES_H
+#define REQUESTLANES_H
+
+#include "IPNetwork.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+//priority classes of route work
+enum RequestLane
+{
+    LANE_NEW=0, //first-seen destination, client is waiting for it right now
+    LANE_RETRY, //repeated request for pending route
+    LANE_REFRESH, //expiration update for active route, missed by lock-free fast path
+    LANE_REINSTALL, //background re-install of pending routes
+    LANE_COUNT
+};
+
+struct LaneItem
+{
+    IPNetwork dest;
+    uint64_t expiration;
+    uint64_t queuedAt; //monotonic ns
+};
+
+//bounded queues of route work, one per priority class, served by weighted deficit round-robin.
+//total backlog is limited, when it is full items from lower classes are shed to make room: refreshes first, then re-installs, then retries.
+//new destinations are shed only if there is nothing else to shed.
+//the caller decides which lanes may be served in the current round (i.e. only lanes that need no pacer tokens). not thread-safe
+class RequestLanes
+{
+    private:
+        struct Lane
+        {
+            std::deque<LaneItem> items;
+            uint64_t weight=1;
+            uint64_t deficit=0;
+            uint64_t served=0;
+            uint64_t shed=0;
+            uint64_t waitSum=0; //total time spent in queue by served items, ns
+            uint64_t waitMax=0;
+        };
+        Lane lanes[LANE_COUNT];
+        size_t limit;
+        size_t total=0;
+        size_t cur=0;
+        bool MakeRoom(const RequestLane incoming);
+    public:
+        RequestLanes();
+        //weights in the RequestLane order, missing or zero weights are set to 1
+        void Configure(const std::vector<int> &weights, const size_t limit);
+        //returns false if item was shed
+        bool Push(const RequestLane lane, const LaneItem &item);
+        //next item of the lanes selected by mask (bit per RequestLane) by weighted round-robin, must be called only if HasItems(mask)
+        LaneItem Pop(RequestLane &lane, const unsigned mask, const uint64_t now);
+        bool HasItems(const unsigned mask) const;
+        void Clear(const RequestLane lane);
+        size_t Size() const { return total; }
+        size_t Size(const RequestLane lane) const { return lanes[lane].items.size(); }
+        uint64_t Served(const RequestLane lane) const { return lanes[lane].served; }
+        uint64_t Shed(const RequestLane lane) const { return lanes[lane].shed; }
+        uint64_t WaitSum(const RequestLane lane) const { return lanes[lane].waitSum; }
+        uint64_t WaitMax(const RequestLane lane) const { return lanes[lane].waitMax; }
+};
+
+#endif // REQUESTLANES_H
@@ -0,0 +1,133 @@
+#include "RouteMetrics.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <utility>
+
+#include <linux/rtnetlink.h>
+
+//decode value of single metric from comma-separated list, returns 0 if metric is missing, UINT32_MAX on error
+static uint32_t DecodeMetric(const std::string &string, const std::string &name, const uint32_t maxValue)
+{
+    size_t start=0;
+    while(start<=string.length())
+    {
+        auto end=string.find(',',start);
+        auto item=string.substr(start,end==std::string::npos?std::string::npos:end-start);
+        auto pos=item.find('=');
+        if(pos!=std::string::npos && item.substr(0,pos)==name)
+        {
+            auto valStr=item.substr(pos+1);
+            if(valStr.empty()||valStr.length()>9||valStr.find_first_not_of("0123456789")!=std::string::npos)
+                return UINT32_MAX;
+            auto value=static_cast<uint32_t>(std::strtoul(valStr.c_str(),nullptr,10));
+            return value>maxValue?UINT32_MAX:value;
+        }
+        if(end==std::string::npos)
+            break;
+        start=end+1;
+    }
+    return 0;
+}
+
+//check that every item in the list is a known metric
+static bool ValidateMetrics(const std::string &string)
+{
+    static const char * const names[]={"initcwnd","initrwnd","mtu","advmss","quickack"};
+    if(string.empty())
+        return true;
+    size_t start=0;
+    while(start<=string.length())
+    {
+        auto end=string.find(',',start);
+        auto item=string.substr(start,end==std::string::npos?std::string::npos:end-start);
+        auto name=item.substr(0,item.find('='));
+        bool known=false;
+        for(auto el : names)
+            known|=name==el;
+        if(!known||item.find('=')==std::string::npos)
+            return false;
+        if(end==std::string::npos)
+            break;
+        start=end+1;
+    }
+    return true;
+}
+
+RouteMetrics::RouteMetrics():
+    initcwnd(0),
+    initrwnd(0),
+    mtu(0),
+    advmss(0),
+    quickack(0),
+    isValid(true)
+{
+}
+
+RouteMetrics::RouteMetrics(const RouteMetrics& other):
+    initcwnd(other.initcwnd),
+    initrwnd(other.initrwnd),
+    mtu(other.mtu),
+    advmss(other.advmss),
+    quickack(other.quickack),
+    isValid(other.isValid)
+{
+}
+
+RouteMetrics::RouteMetrics(const std::string &string):
+    initcwnd(DecodeMetric(string,"initcwnd",1024)),
+    initrwnd(DecodeMetric(string,"initrwnd",1024)),
+    mtu(DecodeMetric(string,"mtu",65535)),
+    advmss(DecodeMetric(string,"advmss",65535)),
+    quickack(DecodeMetric(string,"quickack",1)),
+    isValid(ValidateMetrics(string)&&initcwnd!=UINT32_MAX&&initrwnd!=UINT32_MAX&&mtu!=UINT32_MAX&&advmss!=UINT32_MAX&&quickack!=UINT32_MAX)
+{
+}
+
+size_t RouteMetrics::Encode(unsigned char * const buffer, const size_t maxLen) const
+{
+    if(!isValid)
+        return 0;
+    const std::pair<unsigned short,uint32_t> metrics[]={{RTAX_INITCWND,initcwnd},{RTAX_INITRWND,initrwnd},{RTAX_MTU,mtu},{RTAX_ADVMSS,advmss},{RTAX_QUICKACK,quickack}};
+    size_t len=0;
+    for(auto const &el : metrics)
+    {
+        if(el.second==0)
+            continue;
+        auto rtaLen=static_cast<unsigned short>(RTA_LENGTH(sizeof(uint32_t)));
+        if(len+RTA_ALIGN(rtaLen)>maxLen)
+            return 0;
+        rtattr rtaHDR;
+        rtaHDR.rta_type=el.first;
+        rtaHDR.rta_len=rtaLen;
+        memcpy(reinterpret_cast<void*>(buffer+len),reinterpret_cast<void*>(&rtaHDR),sizeof(rtattr));
+        memcpy(RTA_DATA(buffer+len),&el.second,sizeof(uint32_t));
+        len+=RTA_ALIGN(rtaLen);
+    }
+    return len;
+}
+
+bool RouteMetrics::IsEmpty() const
+{
+    return !isValid||(initcwnd==0&&initrwnd==0&&mtu==0&&advmss==0&&quickack==0);
+}
+
+std::ostream& operator<<(std::ostream& stream, const RouteMetrics& target)
+{
+    if(target.IsEmpty())
+        return stream<<"not set";
+    bool first=true;
+    auto print=[&](const char * const name, const uint32_t value)
+    {
+        if(value==0)
+            return;
+        stream<<(first?"":",")<<name<<"="<<value;
+        first=false;
+    };
+    print("initcwnd",target.initcwnd);
+    print("initrwnd",target.initrwnd);
+    print("mtu",target.mtu);
+    print("advmss",target.advmss);
+    print("quickack",target.quickack);
+    return stream;
+}
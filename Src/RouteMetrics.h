@@ -0,0 +1,30 @@
+#ifndef ROUTEMETRICS_H
+#define ROUTEMETRICS_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+//per-route kernel metrics (RTA_METRICS) for generated routes, zero value means "not set, use kernel default"
+class RouteMetrics
+{
+    public:
+        RouteMetrics();
+        RouteMetrics(const RouteMetrics &other);
+        RouteMetrics(const std::string &string); //comma-separated "name=value" list, i.e. "initcwnd=10,mtu=1400", empty string - no metrics
+
+        //encode nested RTA_METRICS payload to the buffer, returns payload length or 0 if nothing to encode or buffer is too small
+        size_t Encode(unsigned char * const buffer, const size_t maxLen) const;
+        bool IsEmpty() const;
+
+        friend std::ostream& operator<<(std::ostream& stream, const RouteMetrics& target);
+
+        const uint32_t initcwnd;
+        const uint32_t initrwnd;
+        const uint32_t mtu;
+        const uint32_t advmss;
+        const uint32_t quickack;
+        const bool isValid;
+};
+
+#endif // ROUTEMETRICS_H
@@ -0,0 +1,86 @@
+#include "RoutePacer.h"
+
+#include <algorithm>
+#include <string>
+
+//lowest rate auto-calibration may set, routes per second
+#define PACE_MIN_RATE 100.0
+//weight of the new sample in route cost moving average
+#define PACE_COST_ALPHA 0.2
+#define NS_PER_SEC_F 1000000000.0
+
+RoutePacer::RoutePacer(const int _maxRate, const int _burst, const int _targetSharePct):
+    maxRate(_maxRate>0?static_cast<double>(_maxRate):0.0),
+    burst(_burst>0?static_cast<double>(_burst):std::max(1.0,static_cast<double>(_maxRate))),
+    targetShare(_targetSharePct>0?static_cast<double>(_targetSharePct)/100.0:0.0),
+    rate(maxRate),
+    tokens(burst)
+{
+}
+
+void RoutePacer::Refill(const uint64_t now)
+{
+    if(lastRefill==0||now<lastRefill)
+    {
+        lastRefill=now;
+        return;
+    }
+    tokens=std::min(burst,tokens+rate*static_cast<double>(now-lastRefill)/NS_PER_SEC_F);
+    lastRefill=now;
+}
+
+size_t RoutePacer::Take(const size_t count, const uint64_t now, const bool overdraft)
+{
+    if(!IsEnabled())
+        return count;
+    const std::lock_guard<std::mutex> guard(lock);
+    Refill(now);
+    auto available=overdraft?tokens+burst:tokens;
+    auto granted=available<1.0?0:std::min(count,static_cast<size_t>(available));
+    tokens-=static_cast<double>(granted);
+    if(granted<count)
+        deferrals++;
+    return granted;
+}
+
+void RoutePacer::Return(const size_t count)
+{
+    if(!IsEnabled()||count<1)
+        return;
+    const std::lock_guard<std::mutex> guard(lock);
+    tokens=std::min(burst,tokens+static_cast<double>(count));
+}
+
+uint64_t RoutePacer::NextAvailable(const size_t count, const uint64_t now, const bool overdraft)
+{
+    if(!IsEnabled())
+        return now;
+    const std::lock_guard<std::mutex> guard(lock);
+    Refill(now);
+    auto target=std::max(1.0,std::min(burst,static_cast<double>(count)))-(overdraft?burst:0.0);
+    if(tokens>=target)
+        return now;
+    return now+static_cast<uint64_t>((target-tokens)/rate*NS_PER_SEC_F)+1;
+}
+
+void RoutePacer::Calibrate(const size_t routes, const uint64_t durationNs)
+{
+    if(!IsEnabled()||routes<1)
+        return;
+    const std::lock_guard<std::mutex> guard(lock);
+    auto cost=static_cast<double>(durationNs)/static_cast<double>(routes);
+    routeCostNs=routeCostNs>0?routeCostNs+(cost-routeCostNs)*PACE_COST_ALPHA:cost;
+    if(targetShare>0&&routeCostNs>0)
+        rate=std::max(std::min(maxRate,PACE_MIN_RATE),std::min(maxRate,targetShare*NS_PER_SEC_F/routeCostNs));
+}
+
+std::ostream& operator<<(std::ostream& stream, const RoutePacer& target)
+{
+    if(!target.IsEnabled())
+        return stream<<"disabled";
+    const std::lock_guard<std::mutex> guard(target.lock);
+    stream<<"rate="<<target.rate<<" routes/s (max "<<target.maxRate<<", burst "<<target.burst<<"); ";
+    stream<<"route cost="<<target.routeCostNs/1000.0<<" us; auto-calibration="<<(target.targetShare>0?std::to_string(static_cast<int>(target.targetShare*100.0))+"%":std::string("disabled"));
+    stream<<"; deferred batches="<<target.deferrals;
+    return stream;
+}
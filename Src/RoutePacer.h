@@ -0,0 +1,42 @@
+#ifndef ROUTEPACER_H
+#define ROUTEPACER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <iostream>
+
+//token bucket limiting the rate of routes pushed to kernel, so the kernel rtnl lock is not held by us for too long.
+//tokens are consumed only by routes pushed to kernel, order of route work is decided by RequestLanes.
+//first-seen destinations may overdraw the bucket by up to burst size, so short bursts of them are never delayed
+//and bulk work yields to them, while a sustained flood of them is still limited to the rate.
+//with auto-calibration the rate is lowered until route programming takes no more than target share of time,
+//the cost of single route is measured from duration of netlink requests (rtnetlink processes them synchronously on send)
+class RoutePacer
+{
+    private:
+        mutable std::mutex lock;
+        const double maxRate; //routes per second, 0 - pacing disabled
+        const double burst; //maximum tokens accumulated
+        const double targetShare; //share of time allowed for route programming, 0 - auto-calibration disabled
+        double rate;
+        double tokens;
+        uint64_t lastRefill=0; //monotonic ns
+        double routeCostNs=0; //moving average of kernel time spent per route
+        uint64_t deferrals=0; //count of drain rounds delayed because of token shortage
+        void Refill(const uint64_t now);
+    public:
+        RoutePacer(const int maxRate, const int burst, const int targetSharePct);
+        bool IsEnabled() const { return maxRate>0; }
+        //grant up to count tokens, unused ones may be returned. with overdraft tokens balance may go down to -burst
+        size_t Take(const size_t count, const uint64_t now, const bool overdraft=false);
+        void Return(const size_t count);
+        //time when requested count of tokens will be available (but no more than burst size), monotonic ns
+        uint64_t NextAvailable(const size_t count, const uint64_t now, const bool overdraft=false);
+        //update route cost and calibrated rate from measured duration of netlink request with given routes count
+        void Calibrate(const size_t routes, const uint64_t durationNs);
+
+        friend std::ostream& operator<<(std::ostream& stream, const RoutePacer& target);
+};
+
+#endif // ROUTEPACER_H
@@ -0,0 +1,153 @@
+#include "RouteSnapshot.h"
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC "PDNSRMS"
+#define SNAPSHOT_VERSION 1
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t count;
+    uint64_t savedAt; //wall-clock seconds
+    int32_t metric;
+    int32_t ksMetric;
+    uint64_t checksum; //FNV-1a of all records
+};
+
+static_assert(sizeof(SnapshotHeader)%8==0,"snapshot records must be aligned");
+static_assert(sizeof(RouteSnapshot::Record)==56,"snapshot record layout is changed, SNAPSHOT_VERSION must be increased");
+
+static uint64_t Checksum(const unsigned char * const data, const size_t len)
+{
+    uint64_t hash=14695981039346656037ULL;
+    for(size_t i=0;i<len;++i)
+    {
+        hash^=data[i];
+        hash*=1099511628211ULL;
+    }
+    return hash;
+}
+
+RouteSnapshot::RouteSnapshot(ILogger &_logger, const std::string &_filename):
+    logger(_logger),
+    filename(_filename)
+{
+}
+
+bool RouteSnapshot::Save(const int metric, const int ksMetric, const std::vector<Record> &records)
+{
+    SnapshotHeader header={};
+    memcpy(header.magic,SNAPSHOT_MAGIC,sizeof(SNAPSHOT_MAGIC));
+    header.version=SNAPSHOT_VERSION;
+    header.recordSize=sizeof(Record);
+    header.count=records.size();
+    header.savedAt=static_cast<uint64_t>(time(nullptr));
+    header.metric=metric;
+    header.ksMetric=ksMetric;
+    header.checksum=Checksum(reinterpret_cast<const unsigned char*>(records.data()),records.size()*sizeof(Record));
+
+    //snapshot is replaced atomically, so the next process never sees partially written file
+    auto tmpName=filename+".tmp";
+    auto fd=open(tmpName.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0600);
+    if(fd==-1)
+    {
+        logger.Error()<<"Failed to create route state snapshot "<<tmpName<<": "<<strerror(errno)<<std::endl;
+        return false;
+    }
+    auto ok=write(fd,&header,sizeof(header))==static_cast<ssize_t>(sizeof(header));
+    auto data=reinterpret_cast<const unsigned char*>(records.data());
+    size_t left=records.size()*sizeof(Record);
+    while(ok&&left>0)
+    {
+        auto written=write(fd,data,left);
+        if(written<=0)
+        {
+            ok=false;
+            break;
+        }
+        data+=written;
+        left-=static_cast<size_t>(written);
+    }
+    ok=ok&&fsync(fd)==0;
+    if(!ok)
+        logger.Error()<<"Failed to write route state snapshot "<<tmpName<<": "<<strerror(errno)<<std::endl;
+    close(fd);
+    if(ok&&rename(tmpName.c_str(),filename.c_str())!=0)
+    {
+        logger.Error()<<"Failed to replace route state snapshot "<<filename<<": "<<strerror(errno)<<std::endl;
+        ok=false;
+    }
+    if(!ok)
+        unlink(tmpName.c_str());
+    return ok;
+}
+
+bool RouteSnapshot::Load(const int metric, const int ksMetric, std::vector<Record> &records)
+{
+    auto fd=open(filename.c_str(),O_RDONLY|O_CLOEXEC);
+    if(fd==-1)
+    {
+        if(errno!=ENOENT)
+            logger.Warning()<<"Failed to open route state snapshot "<<filename<<": "<<strerror(errno)<<std::endl;
+        return false;
+    }
+    struct stat st={};
+    void *map=MAP_FAILED;
+    if(fstat(fd,&st)==0&&st.st_size>=static_cast<off_t>(sizeof(SnapshotHeader)))
+        map=mmap(nullptr,static_cast<size_t>(st.st_size),PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    //snapshot describes state at the moment of shutdown, it is never valid for the second time
+    unlink(filename.c_str());
+    if(map==MAP_FAILED)
+    {
+        logger.Warning()<<"Failed to map route state snapshot "<<filename<<std::endl;
+        return false;
+    }
+
+    auto size=static_cast<size_t>(st.st_size);
+    auto base=static_cast<const unsigned char*>(map);
+    SnapshotHeader header={};
+    memcpy(&header,base,sizeof(header));
+    std::string error;
+    if(memcmp(header.magic,SNAPSHOT_MAGIC,sizeof(SNAPSHOT_MAGIC))!=0||header.version!=SNAPSHOT_VERSION||header.recordSize!=sizeof(Record))
+        error="unsupported format";
+    else if(header.count>(size-sizeof(header))/sizeof(Record)||size!=sizeof(header)+header.count*sizeof(Record))
+        error="invalid size";
+    else if(Checksum(base+sizeof(header),size-sizeof(header))!=header.checksum)
+        error="checksum mismatch";
+    else if(header.metric!=metric||header.ksMetric!=ksMetric)
+        error="route metrics mismatch";
+    if(error.empty())
+    {
+        records.resize(header.count);
+        memcpy(reinterpret_cast<void*>(records.data()),base+sizeof(header),header.count*sizeof(Record));
+        auto now=static_cast<uint64_t>(time(nullptr));
+        logger.Info()<<"Route state snapshot "<<filename<<" loaded: "<<header.count<<" routes saved "<<(now>header.savedAt?now-header.savedAt:0)<<" s ago"<<std::endl;
+    }
+    else
+        logger.Warning()<<"Ignoring route state snapshot "<<filename<<": "<<error<<std::endl;
+    munmap(map,size);
+    return error.empty();
+}
+
+void RouteSnapshot::SetDestination(Record &record, const IPNetwork &dest)
+{
+    memcpy(record.ip,dest.ip.RawData(),dest.isV6?IPV6_ADDR_LEN:IPV4_ADDR_LEN);
+    record.isV6=dest.isV6?1:0;
+    record.prefixLen=static_cast<unsigned char>(dest.prefixLen);
+}
+
+IPNetwork RouteSnapshot::GetDestination(const Record &record)
+{
+    return IPNetwork(IPAddress(record.ip,record.isV6?IPV6_ADDR_LEN:IPV4_ADDR_LEN),record.prefixLen);
+}
@@ -0,0 +1,43 @@
+#ifndef ROUTESNAPSHOT_H
+#define ROUTESNAPSHOT_H
+
+#include "ILogger.h"
+#include "IPNetwork.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//compact binary snapshot of route state, written on shutdown and taken over by the next process on startup.
+//times are stored as wall-clock seconds, so they survive the restart. native byte order, the file is not portable between hosts
+class RouteSnapshot
+{
+    public:
+        struct Record
+        {
+            uint64_t expiration; //UINT64_MAX - route never expires
+            uint64_t added;
+            uint64_t lastRequest;
+            uint32_t avgInterval; //seconds, 0 - never re-resolved
+            uint32_t requests;
+            unsigned char ip[16];
+            unsigned char isV6;
+            unsigned char prefixLen;
+            unsigned char isActive; //0 - route is pending, it was not confirmed by kernel
+            unsigned char reserved[5];
+        };
+
+        RouteSnapshot(ILogger &logger, const std::string &filename);
+        //write records to temporary file and replace the snapshot with it, metrics are used to verify that snapshot matches routes of the next process
+        bool Save(const int metric, const int ksMetric, const std::vector<Record> &records);
+        //map the snapshot and read its records, the file is removed, so it cannot be used twice. returns false if snapshot is missing or invalid
+        bool Load(const int metric, const int ksMetric, std::vector<Record> &records);
+
+        static void SetDestination(Record &record, const IPNetwork &dest);
+        static IPNetwork GetDestination(const Record &record);
+    private:
+        ILogger &logger;
+        const std::string filename;
+};
+
+#endif // ROUTESNAPSHOT_H
@@ -1,56 +1,136 @@
 #include "RoutingManager.h"
+#include "RouteSnapshot.h"
 
 #include <thread>
 #include <chrono>
 #include <cstring>
 #include <cerrno>
+#include <cstdint>
 #include <forward_list>
+#include <algorithm>
 
 #include <unistd.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
+#ifdef HAVE_LINUX_NEXTHOP_H
+#include <linux/nexthop.h>
+#endif
 #include <net/if.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 
 class ShutdownMessage: public IShutdownMessage { public: ShutdownMessage(int _ec):IShutdownMessage(_ec){} };
 
+//size of batched netlink messages buffer, batch will be sent when it is full
+#define NL_BATCH_SIZE 65536
+//expiry deadlines are delayed by random time up to this value, so shards with many routes expiring at the same second do not wake at once
+#define EXPIRE_JITTER_MS 250
+//pause between batches of expired routes removal when time budget is exhausted, so other shard operations are not starved
+#define EXPIRE_BATCH_PAUSE_MS 5
+//maximum routes re-installed at once, so their ACKs fit into socket buffer and other events are served between chunks
+#define REINSTALL_CHUNK 128
+//rejected routes are retried after management interval multiplied by 2^rejects, up to this power
+#define RETRY_BACKOFF_MAX_SHIFT 5
+//when route limit is reached, this share (1/N) of shard route limit is evicted at once, so the scan of active routes is amortized
+#define EVICT_BATCH_DIV 64
+//fill alert is cleared when route count drops below this percent of alert level
+#define ALERT_CLEAR_PCT 90
+//number of route removal counters, destinations sharing a counter only cause extra route requests to pass deduplication
+#define REMOVAL_GEN_BUCKETS 4096
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
 //MUST be a POD type
 struct RouteMsg
 {
     public:
         nlmsghdr nl;
         rtmsg rt;
+        unsigned char data[128];
+};
+
+#ifdef HAVE_LINUX_NEXTHOP_H
+//MUST be a POD type
+struct NexthopMsg
+{
+    public:
+        nlmsghdr nl;
+        nhmsg nh;
         unsigned char data[64];
 };
+#endif
 
-RoutingManager::RoutingManager(ILogger &_logger, const std::string &_ifname, const IPAddress &_gateway4, const IPAddress &_gateway6, const unsigned int _extraTTL, const int _mgIntervalSec, const int _mgPercent, const int _metric, const int _ksMetric, const int _addRetryCount):
+
+RoutingManager::RoutingManager(ILogger &_logger, const std::vector<EgressPath> &_paths, const TtlPolicy &_ttlPolicy, const int _mgIntervalSec, const int _mgBudgetMs, const int _metric, const int _ksMetric, const int _addRetryCount, const int _prefixLen4, const int _prefixLen6, const std::set<IPNetwork> &_staticRoutes, const bool _fibFilter, const uint32_t _nhID, const RouteMetrics &_routeMetrics, const int _shardCount, const int _paceRate, const int _paceBurst, const int _paceShare, const std::vector<int> &_laneWeights, const int _laneLimit, const int _maxRoutes, const bool _evictLFU, const int _alertPct, const std::string &_snapshotFile):
     logger(_logger),
-    ifname(_ifname),
-    gateway4(_gateway4),
-    gateway6(_gateway6),
-    extraTTL(_extraTTL),
+    paths(_paths),
+    ttlPolicy(_ttlPolicy),
     mgIntervalSec(_mgIntervalSec),
-    mgPercent(_mgPercent),
+    mgBudgetMs(_mgBudgetMs),
     metric(_metric),
     ksMetric(_ksMetric),
     addRetryCount(_addRetryCount),
-    ifCfg(ImmutableStorage<InterfaceConfig>(InterfaceConfig()))
+    prefixLen4(_prefixLen4),
+    prefixLen6(_prefixLen6),
+    staticRoutes(_staticRoutes),
+    fibFilter(_fibFilter),
+    nhID(_nhID),
+    routeMetrics(_routeMetrics),
+    shardCount(_shardCount<1?1:static_cast<size_t>(_shardCount)),
+    shardRouteLimit(_maxRoutes>0?(static_cast<size_t>(_maxRoutes)+shardCount-1)/shardCount:0),
+    evictLFU(_evictLFU),
+    alertLevel(std::max(static_cast<size_t>(1),shardRouteLimit*static_cast<size_t>(_alertPct)/100)),
+    snapshotFile(_snapshotFile),
+    pacer(_paceRate,_paceBurst,_paceShare),
+    removalGens(new std::atomic<uint64_t>[REMOVAL_GEN_BUCKETS]),
+    pathCfg(_paths.size(),std::make_shared<const InterfaceConfig>())
 {
-    _UpdateCurTime();
+    UpdateCurTime();
     shutdownPending.store(false);
-    started=false;
+    started.store(false);
+    fastRefreshCount.store(0);
+    requestBatches.store(0);
+    requestCount.store(0);
+    confirmBatches.store(0);
+    confirmCount.store(0);
+    ackSeq.store(0);
+    fibRemovalGen.store(0);
+    for(size_t i=0;i<REMOVAL_GEN_BUCKETS;++i)
+        removalGens[i].store(0);
+    for(size_t i=0;i<shardCount;++i)
+    {
+        shards.push_back(std::unique_ptr<Shard>(new Shard()));
+        shards.back()->jitter.seed(static_cast<std::minstd_rand::result_type>(i+1));
+        shards.back()->lanes.Configure(_laneWeights,static_cast<size_t>(_laneLimit));
+        //preallocate route tables, so they are never rehashed while growing up to the limit
+        if(shardRouteLimit>0)
+        {
+            shards.back()->activeRoutes.reserve(shardRouteLimit);
+            shards.back()->pendingInserts.reserve(shardRouteLimit);
+            shards.back()->pendingRetries.reserve(shardRouteLimit);
+        }
+    }
+    std::atomic_store(&pathState,std::shared_ptr<const PathState>(new PathState{-1,-1,std::vector<bool>(_paths.size(),false)}));
     sock=-1;
 }
 
 //overrodes for performing some extra-init
 bool RoutingManager::Startup()
+{
+    //start background worker that will do periodical cleanup
+    return Open()&&WorkerBase::Startup();
+}
+
+//open netlink socket and timers, schedule static routes
+bool RoutingManager::Open()
 {
     const std::lock_guard<std::mutex> lock(opLock);
 
     //open netlink socket
-    logger.Info()<<"Preparing RoutingManager for interface: "<<ifname<<std::endl;
+    for(auto const &path : paths)
+        logger.Info()<<"Preparing RoutingManager for interface: "<<path.ifname<<std::endl;
 
     sock=socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
     if(sock==-1)
@@ -69,35 +149,489 @@ bool RoutingManager::Startup()
         return false;
     }
 
-    started=true;
+    //ACKs for a chunk of re-installs from every shard must fit into receive buffer, single ACK takes less than 1KiB
+    int rcvBuf=static_cast<int>(shardCount)*REINSTALL_CHUNK*1024;
+    if(setsockopt(sock,SOL_SOCKET,SO_RCVBUFFORCE,&rcvBuf,sizeof(rcvBuf))!=0&&setsockopt(sock,SOL_SOCKET,SO_RCVBUF,&rcvBuf,sizeof(rcvBuf))!=0)
+        logger.Warning()<<"Failed to set netlink receive buffer size: "<<strerror(errno)<<std::endl;
 
-    //start background worker that will do periodical cleanup
-    return WorkerBase::Startup();
+    //ask kernel for error messages explaining rejected requests, not supported before linux 4.12
+    int extAck=1;
+    if(setsockopt(sock,SOL_NETLINK,NETLINK_EXT_ACK,&extAck,sizeof(extAck))!=0)
+        logger.Warning()<<"Failed to enable netlink extended ACK: "<<strerror(errno)<<std::endl;
+
+    //open expiration timers
+    for(auto &shard : shards)
+    {
+        shard->timer=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+        if(shard->timer==-1)
+        {
+            logger.Error()<<"Failed to create timerfd: "<<strerror(errno)<<std::endl;
+            return false;
+        }
+    }
+
+    started.store(true);
+    _RestoreSnapshot();
+
+    //static routes will be pushed by _ProcessPendingInserts as soon as the interface becomes available
+    for(auto const &dest : staticRoutes)
+    {
+        auto &shard=GetShard(dest);
+        const std::lock_guard<std::mutex> shardLock(shard.lock);
+        if(shard.activeRoutes.find(dest)!=shard.activeRoutes.end())
+            continue; //restored from snapshot
+        logger.Info()<<"Adding static routing rule for: "<<dest<<std::endl;
+        shard.pendingInserts[dest]=UINT64_MAX;
+        _ScheduleRetry(shard,0);
+    }
+    return true;
 }
 
 bool RoutingManager::Shutdown()
 {
     //stop background worker
     auto result=WorkerBase::Shutdown();
+    return Close()&&result;
+}
 
+bool RoutingManager::Close()
+{
     const std::lock_guard<std::mutex> lock(opLock);
-    started=false;
-    //close netlink socket
-    if(close(sock)!=0)
+    if(started.load())
+        _SaveSnapshot();
+    started.store(false);
+    for(auto &shard : shards)
+    {
+        const std::lock_guard<std::mutex> shardLock(shard->lock);
+        if(shard->timer!=-1&&close(shard->timer)!=0)
+            logger.Error()<<"Failed to close timerfd: "<<strerror(errno)<<std::endl;
+        shard->timer=-1;
+    }
+    //close netlink socket, it may be already closed by Detach
+    if(sock==-1)
+        return true;
+    auto result=close(sock);
+    sock=-1;
+    if(result!=0)
     {
         logger.Error()<<"Failed to close netlink socket: "<<strerror(errno)<<std::endl;
         return false;
     }
+    return true;
+}
+
+//read routes installed by this program from kernel: unicast routes with our metric and their interface, blackhole routes with killswitch metric
+bool RoutingManager::DumpOwnRoutes(std::unordered_map<IPNetwork,unsigned int> &unicast, std::unordered_set<IPNetwork> &blackholes)
+{
+    //separate socket is used, so the dump is not mixed with replies to route requests
+    auto dumpSock=socket(PF_NETLINK,SOCK_RAW|SOCK_CLOEXEC,NETLINK_ROUTE);
+    if(dumpSock==-1)
+    {
+        logger.Error()<<"Failed to open netlink socket for routes dump: "<<strerror(errno)<<std::endl;
+        return false;
+    }
+    struct
+    {
+        nlmsghdr nl;
+        rtmsg rt;
+    } req={};
+    req.nl.nlmsg_len=NLMSG_LENGTH(sizeof(rtmsg));
+    req.nl.nlmsg_type=RTM_GETROUTE;
+    req.nl.nlmsg_flags=NLM_F_REQUEST|NLM_F_DUMP;
+    req.nl.nlmsg_seq=1;
+    req.rt.rtm_family=AF_UNSPEC;
+    auto result=send(dumpSock,&req,req.nl.nlmsg_len,0)==static_cast<ssize_t>(req.nl.nlmsg_len);
+    if(!result)
+        logger.Error()<<"Failed to request routes dump: "<<strerror(errno)<<std::endl;
+    std::vector<unsigned char> buf(NL_BATCH_SIZE);
+    auto done=false;
+    while(result&&!done)
+    {
+        auto len=recv(dumpSock,buf.data(),buf.size(),0);
+        if(len<0)
+        {
+            if(errno==EINTR)
+                continue;
+            logger.Error()<<"Failed to read routes dump: "<<strerror(errno)<<std::endl;
+            result=false;
+            break;
+        }
+        for(auto nh=reinterpret_cast<nlmsghdr*>(buf.data());NLMSG_OK(nh,len);nh=NLMSG_NEXT(nh,len))
+        {
+            if(nh->nlmsg_type==NLMSG_DONE||nh->nlmsg_type==NLMSG_ERROR)
+            {
+                //interrupted dump may miss some routes, it is safer to not trust the snapshot
+                result=nh->nlmsg_type==NLMSG_DONE&&(nh->nlmsg_flags&NLM_F_DUMP_INTR)==0;
+                done=true;
+                break;
+            }
+            if(nh->nlmsg_type!=RTM_NEWROUTE)
+                continue;
+            auto rtm=reinterpret_cast<rtmsg*>(reinterpret_cast<unsigned char*>(nh)+NLMSG_HDRLEN);
+            if((rtm->rtm_family!=AF_INET&&rtm->rtm_family!=AF_INET6)||rtm->rtm_table!=RT_TABLE_MAIN||rtm->rtm_protocol!=RTPROT_STATIC||rtm->rtm_scope!=RT_SCOPE_UNIVERSE)
+                continue;
+            if(rtm->rtm_type!=RTN_UNICAST&&rtm->rtm_type!=RTN_BLACKHOLE)
+                continue;
+            const rtattr *dst=nullptr;
+            unsigned int ifIdx=0;
+            int prio=-1;
+            auto rtl=RTM_PAYLOAD(nh);
+            for(auto rth=RTM_RTA(rtm);RTA_OK(rth,rtl);rth=RTA_NEXT(rth,rtl))
+            {
+                if(rth->rta_type==RTA_DST)
+                    dst=rth;
+                else if(rth->rta_type==RTA_OIF)
+                    memcpy(&ifIdx,RTA_DATA(rth),sizeof(ifIdx));
+                else if(rth->rta_type==RTA_PRIORITY)
+                    memcpy(&prio,RTA_DATA(rth),sizeof(prio));
+            }
+            if(dst==nullptr)
+                continue;
+            const IPNetwork dest(IPAddress(dst),rtm->rtm_dst_len);
+            if(!dest.isValid)
+                continue;
+            if(rtm->rtm_type==RTN_UNICAST&&prio==metric)
+                unicast.emplace(dest,ifIdx);
+            else if(rtm->rtm_type==RTN_BLACKHOLE&&prio==ksMetric)
+                blackholes.insert(dest);
+        }
+    }
+    close(dumpSock);
     return result;
 }
 
+//write state of all routes to snapshot for the next process, so it may take over routes without reinstalling them
+void RoutingManager::_SaveSnapshot()
+{
+    if(snapshotFile.empty())
+        return;
+    auto now=UpdateCurTime();
+    auto wallNow=static_cast<uint64_t>(time(nullptr));
+    //monotonic time to wall-clock time
+    auto toWall=[now,wallNow](const uint64_t time){return time==UINT64_MAX?UINT64_MAX:(time>now?wallNow+(time-now):wallNow-std::min(wallNow,now-time));};
+    std::vector<RouteSnapshot::Record> records;
+    for(auto &shard : shards)
+    {
+        const std::lock_guard<std::mutex> shardLock(shard->lock);
+        for(auto const &el : shard->activeRoutes)
+        {
+            RouteSnapshot::Record record={};
+            RouteSnapshot::SetDestination(record,el.first);
+            record.isActive=1;
+            record.expiration=toWall(el.second->expiration.load());
+            record.added=toWall(el.second->added);
+            record.lastRequest=toWall(el.second->lastRequest.load());
+            record.avgInterval=el.second->avgInterval.load();
+            record.requests=el.second->requests.load();
+            records.push_back(record);
+        }
+        for(auto const &el : shard->pendingInserts)
+        {
+            RouteSnapshot::Record record={};
+            RouteSnapshot::SetDestination(record,el.first);
+            record.expiration=toWall(el.second);
+            record.added=wallNow;
+            record.lastRequest=wallNow;
+            records.push_back(record);
+        }
+    }
+    if(RouteSnapshot(logger,snapshotFile).Save(metric,ksMetric,records))
+        logger.Info()<<"Route state saved to snapshot "<<snapshotFile<<": "<<records.size()<<" routes"<<std::endl;
+}
+
+//take over routes left in kernel by the previous process: routes confirmed by kernel dump are restored as active without touching them,
+//the rest is pending and will be pushed by retry round. routes expired while nobody was managing them are removed
+void RoutingManager::_RestoreSnapshot()
+{
+    if(snapshotFile.empty())
+        return;
+    std::vector<RouteSnapshot::Record> records;
+    if(!RouteSnapshot(logger,snapshotFile).Load(metric,ksMetric,records))
+        return;
+    std::unordered_map<IPNetwork,unsigned int> unicast;
+    std::unordered_set<IPNetwork> blackholes;
+    if(!DumpOwnRoutes(unicast,blackholes))
+    {
+        logger.Warning()<<"Failed to verify route state snapshot with kernel routes, snapshot is ignored"<<std::endl;
+        return;
+    }
+    auto now=UpdateCurTime();
+    auto wallNow=static_cast<uint64_t>(time(nullptr));
+    //wall-clock time to monotonic time
+    auto toMono=[now,wallNow](const uint64_t time){return time>wallNow?now+(time-wallNow):now-std::min(now,wallNow-time);};
+    size_t active=0, pending=0, expired=0;
+    std::vector<unsigned char> batch;
+    for(auto const &record : records)
+    {
+        auto dest=RouteSnapshot::GetDestination(record);
+        if(!dest.isValid)
+            continue;
+        auto uIT=unicast.find(dest);
+        auto hasBlackhole=blackholes.find(dest)!=blackholes.end();
+        uint64_t expiration=UINT64_MAX;
+        if(record.expiration==UINT64_MAX)
+        {
+            //static route removed from configuration is kept as regular one
+            if(staticRoutes.find(dest)==staticRoutes.end())
+                expiration=now+ttlPolicy.Lifetime(0,0);
+        }
+        else if(record.expiration<=wallNow)
+        {
+            if(uIT!=unicast.end())
+                ProcessRoute(dest,false,false,&batch);
+            if(hasBlackhole)
+                ProcessRoute(dest,true,false,&batch);
+            expired++;
+            continue;
+        }
+        else
+            expiration=toMono(record.expiration);
+        auto &shard=GetShard(dest);
+        const std::lock_guard<std::mutex> shardLock(shard.lock);
+        if(record.isActive!=0&&uIT!=unicast.end())
+        {
+            auto route=std::make_shared<ActiveRoute>(expiration,toMono(record.added));
+            route->lastRequest.store(toMono(record.lastRequest));
+            route->avgInterval.store(record.avgInterval);
+            route->requests.store(record.requests);
+            shard.activeRoutes[dest]=route;
+            shard.activeIndexDirty=true;
+            shard.pendingExpires.insert({expiration,dest});
+            if(expiration!=UINT64_MAX)
+                _ArmTimer(shard,expiration*NS_PER_SEC+(shard.jitter()%EXPIRE_JITTER_MS)*NS_PER_MS,false);
+            //killswitch may be removed while nobody was managing the route
+            if(!hasBlackhole)
+                ProcessRoute(dest,true,true,&batch);
+            if(nhID==0)
+                restoredPaths.emplace(dest,uIT->second);
+            active++;
+        }
+        else
+        {
+            //route was not confirmed before shutdown or it is missing from kernel now
+            shard.pendingInserts[dest]=expiration;
+            _ScheduleRetry(shard,0);
+            pending++;
+        }
+    }
+    SendBatch(batch);
+    for(auto &shard : shards)
+    {
+        const std::lock_guard<std::mutex> shardLock(shard->lock);
+        _PublishActiveIndex(*shard);
+    }
+    logger.Info()<<"Restored route state from snapshot: active="<<active<<"; pending="<<pending<<"; expired="<<expired<<std::endl;
+}
+
+bool RoutingManager::Attach(Reactor &_reactor)
+{
+    if(!Open())
+        return false;
+    reactor=&_reactor;
+    if(!reactor->Add(sock,*this))
+        return false;
+    for(auto &shard : shards)
+        if(!reactor->Add(shard->timer,*this))
+            return false;
+    logger.Info()<<"RoutingManager attached to reactor, route state shards: "<<shardCount<<std::endl;
+    return true;
+}
+
+void RoutingManager::Detach()
+{
+    if(reactor==nullptr)
+        return;
+    reactor->Remove(sock);
+    for(auto &shard : shards)
+        reactor->Remove(shard->timer);
+    reactor=nullptr;
+    logger.Info()<<"Detaching RoutingManager from reactor"<<std::endl;
+    Close();
+}
+
+void RoutingManager::OnReactorEvent(const int fd, const uint32_t)
+{
+    if(fd==sock)
+    {
+        ProcessNetlinkReplies();
+        return;
+    }
+    for(auto &shard : shards)
+    {
+        uint64_t expirations=0;
+        if(shard->timer==fd&&read(fd,&expirations,sizeof(expirations))==sizeof(expirations))
+            ManageRoutes(*shard);
+    }
+}
+
+//read error replies from kernel, so they are not piled up in the socket buffer
+void RoutingManager::ProcessNetlinkReplies()
+{
+    unsigned char buf[8192];
+    while(true)
+    {
+        auto len=recv(sock,buf,sizeof(buf),MSG_DONTWAIT);
+        if(len<0)
+        {
+            if(errno!=EAGAIN&&errno!=EINTR)
+                logger.Warning()<<"Error reading reply from netlink: "<<strerror(errno)<<std::endl;
+            return;
+        }
+        for(auto nh=reinterpret_cast<nlmsghdr*>(buf);NLMSG_OK(nh,len);nh=NLMSG_NEXT(nh,len))
+        {
+            if(nh->nlmsg_type!=NLMSG_ERROR||nh->nlmsg_len<NLMSG_LENGTH(sizeof(nlmsgerr)))
+                continue;
+            auto err=reinterpret_cast<nlmsgerr*>(reinterpret_cast<unsigned char*>(nh)+NLMSG_HDRLEN);
+            if(err->msg.nlmsg_seq!=0)
+                ProcessNetlinkAck(err->msg.nlmsg_seq,err->error!=0);
+            if(err->error!=0)
+                ProcessNetlinkError(nh);
+        }
+    }
+}
+
+//successful ACK for re-installed route confirms it, kernel does not notify about replacing route with identical one,
+//which happens when route survived link flap
+void RoutingManager::ProcessNetlinkAck(const uint32_t seq, const bool isError)
+{
+    auto shardIdx=static_cast<size_t>(seq&0xFF);
+    if(shardIdx>=shardCount)
+        return;
+    auto &shard=*shards[shardIdx];
+    const std::lock_guard<std::mutex> lock(shard.lock);
+    auto it=shard.ackWaits.find(seq);
+    if(it==shard.ackWaits.end())
+        return;
+    auto dest=it->second;
+    shard.ackWaits.erase(it);
+    if(isError||shard.pendingInserts.find(dest)==shard.pendingInserts.end()||shard.retryHolds.find(dest)!=shard.retryHolds.end())
+        return;
+    logger.Info()<<"Processing route-added ACK for: "<<dest<<std::endl;
+    _FinalizeRouteInsert(shard,dest);
+}
+
+enum RetryPolicy
+{
+    RETRY_BACKOFF,
+    RETRY_ON_NETDEV,
+    RETRY_GIVE_UP,
+};
+
+static RetryPolicy GetRetryPolicy(const int error, const bool useNexthop)
+{
+    switch(error)
+    {
+        //gateway or interface is not usable right now, it may be fixed by interface state change
+        case ENETUNREACH:
+        case EHOSTUNREACH:
+        case ENETDOWN:
+        case ENODEV:
+            return RETRY_ON_NETDEV;
+        //missing nexthop object is reported as invalid request, it is recreated on path change
+        case EINVAL:
+            return useNexthop?RETRY_ON_NETDEV:RETRY_GIVE_UP;
+        //request will never be accepted
+        case ERANGE:
+        case EAFNOSUPPORT:
+        case EOPNOTSUPP:
+        case EPERM:
+        case EACCES:
+            return RETRY_GIVE_UP;
+        //out of memory or other transient errors
+        default:
+            return RETRY_BACKOFF;
+    }
+}
+
+//decode rejected request echoed by kernel and extended ACK message, apply retry policy to rejected route insert
+void RoutingManager::ProcessNetlinkError(const nlmsghdr *nh)
+{
+    auto err=reinterpret_cast<const nlmsgerr*>(reinterpret_cast<const unsigned char*>(nh)+NLMSG_HDRLEN);
+    auto error=-err->error;
+    {
+        const std::lock_guard<std::mutex> lock(errLock);
+        nlErrors[error]++;
+    }
+
+    //original request follows the error code, only its header is included if kernel capped it
+    auto payloadLen=static_cast<size_t>(nh->nlmsg_len-NLMSG_HDRLEN);
+    auto reqLen=sizeof(nlmsghdr);
+    if((nh->nlmsg_flags&NLM_F_CAPPED)==0&&sizeof(int)+err->msg.nlmsg_len<=payloadLen)
+        reqLen=err->msg.nlmsg_len;
+
+    //extended ACK attributes follow the original request
+    std::string reason(strerror(error));
+    if((nh->nlmsg_flags&NLM_F_ACK_TLVS)!=0)
+    {
+        auto base=reinterpret_cast<const unsigned char*>(err);
+        for(auto offset=NLMSG_ALIGN(sizeof(int)+reqLen);offset+NLA_HDRLEN<=payloadLen;)
+        {
+            auto attr=reinterpret_cast<const nlattr*>(base+offset);
+            if(attr->nla_len<NLA_HDRLEN||offset+attr->nla_len>payloadLen)
+                break;
+            if((attr->nla_type&NLA_TYPE_MASK)==NLMSGERR_ATTR_MSG)
+            {
+                auto text=reinterpret_cast<const char*>(attr)+NLA_HDRLEN;
+                reason+=" ("+std::string(text,strnlen(text,attr->nla_len-NLA_HDRLEN))+")";
+            }
+            offset+=NLA_ALIGN(attr->nla_len);
+        }
+    }
+
+    auto &req=err->msg;
+    if((req.nlmsg_type!=RTM_NEWROUTE&&req.nlmsg_type!=RTM_DELROUTE)||reqLen<NLMSG_LENGTH(sizeof(rtmsg)))
+    {
+        logger.Warning()<<"Netlink request rejected: "<<reason<<std::endl;
+        return;
+    }
+
+    //decode route destination
+    auto rtm=reinterpret_cast<const rtmsg*>(reinterpret_cast<const unsigned char*>(&req)+NLMSG_HDRLEN);
+    const rtattr *dstAttr=nullptr;
+    auto rtl=static_cast<int>(reqLen-NLMSG_LENGTH(sizeof(rtmsg)));
+    for(auto rth=reinterpret_cast<const rtattr*>(reinterpret_cast<const unsigned char*>(rtm)+NLMSG_ALIGN(sizeof(rtmsg)));RTA_OK(rth,rtl);rth=RTA_NEXT(rth,rtl))
+        if(rth->rta_type==RTA_DST)
+            dstAttr=rth;
+    const IPNetwork destNet(dstAttr==nullptr?IPAddress():IPAddress(dstAttr),rtm->rtm_dst_len);
+    if(!destNet.isValid)
+    {
+        logger.Warning()<<"Netlink route request rejected: "<<reason<<std::endl;
+        return;
+    }
+
+    //route is already removed, nothing to do
+    if(req.nlmsg_type==RTM_DELROUTE)
+    {
+        if(error!=ESRCH)
+            logger.Warning()<<"Route removal rejected for: "<<destNet<<": "<<reason<<std::endl;
+        return;
+    }
+    //killswitch route failures do not affect pending route state
+    if(rtm->rtm_type==RTN_BLACKHOLE)
+    {
+        logger.Warning()<<"Blackhole route insert rejected for: "<<destNet<<": "<<reason<<std::endl;
+        return;
+    }
+
+    auto &shard=GetShard(destNet);
+    const std::lock_guard<std::mutex> lock(shard.lock);
+    _RejectRouteInsert(shard,destNet,error,reason);
+}
+
 //will be called by WorkerBase::Shutdown() or WorkerBase::RequestShutdown()
 void RoutingManager::OnShutdown()
 {
     shutdownPending.store(true);
 }
 
-uint64_t RoutingManager::_UpdateCurTime()
+static uint64_t MonotonicNs()
+{
+    timespec time={};
+    clock_gettime(CLOCK_MONOTONIC,&time);
+    return static_cast<uint64_t>(time.tv_sec)*NS_PER_SEC+static_cast<uint64_t>(time.tv_nsec);
+}
+
+uint64_t RoutingManager::UpdateCurTime()
 {
     timespec time={};
     clock_gettime(CLOCK_MONOTONIC,&time);
@@ -105,47 +639,366 @@ uint64_t RoutingManager::_UpdateCurTime()
     return static_cast<uint64_t>(static_cast<unsigned>(time.tv_sec));
 }
 
+//IPAddress hash keeps address bytes in the high bits, so it must be mixed before taking the modulo
+static uint64_t MixHash(const IPNetwork &dest)
+{
+    auto hash=static_cast<uint64_t>(dest.GetHashCode());
+    hash^=hash>>33;
+    hash*=0xff51afd7ed558ccdULL;
+    hash^=hash>>33;
+    return hash;
+}
+
+size_t RoutingManager::ShardIndex(const IPNetwork &dest) const
+{
+    return static_cast<size_t>(MixHash(dest)%shardCount);
+}
+
+void RoutingManager::BumpRemovalGeneration(const IPNetwork &dest)
+{
+    removalGens[MixHash(dest)%REMOVAL_GEN_BUCKETS]++;
+}
+
+uint64_t RoutingManager::RemovalGeneration(const IPAddress &ip) const
+{
+    const IPNetwork dest(ip,ip.isV6?prefixLen6:prefixLen4);
+    return removalGens[MixHash(dest)%REMOVAL_GEN_BUCKETS].load()+fibRemovalGen.load();
+}
+
+RoutingManager::Shard& RoutingManager::GetShard(const IPNetwork &dest)
+{
+    return *shards[ShardIndex(dest)];
+}
+
 void RoutingManager::Worker()
 {
-    logger.Info()<<"RoutingManager worker starting up"<<std::endl;
-    auto prev=curTime.load();
+    logger.Info()<<"RoutingManager worker starting up, route state shards: "<<shardCount<<std::endl;
+    //every shard is managed by its own thread, first shard is managed by this one
+    std::vector<std::thread> shardWorkers;
+    for(size_t i=1;i<shardCount;++i)
+        shardWorkers.push_back(std::thread(&RoutingManager::ShardWorker,this,i));
+    ShardWorker(0);
+    for(auto &shardWorker : shardWorkers)
+        shardWorker.join();
+    logger.Info()<<"Shuting down RoutingManager worker"<<std::endl;
+}
+
+//sleep until the nearest deadline (pending insert retry or route expiration) and process it
+void RoutingManager::ShardWorker(const size_t shardIdx)
+{
+    auto &shard=*shards[shardIdx];
+    //netlink replies are read by the first shard worker only
+    pollfd fds[3]={{shard.timer,POLLIN,0},{GetWakeupFd(),POLLIN,0},{shardIdx==0?sock:-1,POLLIN,0}};
     while (!shutdownPending.load())
     {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        auto now=_UpdateCurTime();
-        if(now-prev>=static_cast<uint64_t>(mgIntervalSec))
+        if(poll(fds,3,-1)<0)
         {
-            prev=now;
-            ManageRoutes();
+            if(errno==EINTR)
+                continue;
+            logger.Error()<<"Error awaiting route management deadline: "<<strerror(errno)<<std::endl;
+            break;
         }
+        if(shutdownPending.load())
+            break;
+        if((fds[2].revents&POLLIN)!=0)
+            ProcessNetlinkReplies();
+        uint64_t expirations=0;
+        if((fds[0].revents&POLLIN)==0||read(shard.timer,&expirations,sizeof(expirations))!=sizeof(expirations))
+            continue;
+        ManageRoutes(shard);
     }
-    logger.Info()<<"Shuting down RoutingManager worker"<<std::endl;
 }
 
-void RoutingManager::ProcessNetDevUpdate(const InterfaceConfig& newConfig)
+void RoutingManager::ProcessNetDevUpdate(const std::string &ifname, const InterfaceConfigPtr &newConfig, const uint64_t eventTime)
 {
     const std::lock_guard<std::mutex> lock(opLock);
-    ifCfg.Set(newConfig); //update config
-    //TODO: if IP availability was changed to false - invalidate all routes immediately
-    auto prevConfig=ifCfg.Prev();
-    _InvalidateActiveRoutes(prevConfig.isIPV4Avail()&&!newConfig.isIPV4Avail(),prevConfig.isIPV6Avail()&&!newConfig.isIPV6Avail());
-    _ProcessPendingInserts(); //trigger pending routes processing immediately
+    auto pathIdx=_FindPath(ifname);
+    if(pathIdx<0)
+        return;
+    pathCfg[static_cast<size_t>(pathIdx)]=newConfig; //update config
+    auto prev4=activePath4;
+    auto prev6=activePath6;
+    activePath4=_SelectPath(false);
+    activePath6=_SelectPath(true);
+    _PublishPathState();
+    _UpdateActivePath(false,prev4,eventTime);
+    _UpdateActivePath(true,prev6,eventTime);
+    //trigger pending routes processing immediately, including routes waiting for interface state change
+    for(auto &shard : shards)
+    {
+        const std::lock_guard<std::mutex> shardLock(shard->lock);
+        for(auto &el : shard->retryHolds)
+            if(el.second.notBefore==UINT64_MAX)
+                el.second.notBefore=0;
+        _ProcessPendingInserts(*shard);
+    }
 }
 
-void RoutingManager::ManageRoutes()
+int RoutingManager::_FindPath(const std::string &ifname) const
 {
-    const std::lock_guard<std::mutex> lock(opLock);
-    _ProcessPendingInserts();
-    _ProcessStaleRoutes();
+    for(size_t i=0;i<paths.size();++i)
+        if(paths[i].ifname==ifname)
+            return static_cast<int>(i);
+    return -1;
+}
+
+//first path in order of preference with ip of requested version available
+int RoutingManager::_SelectPath(const bool isV6) const
+{
+    for(size_t i=0;i<paths.size();++i)
+    {
+        auto &cfg=*pathCfg[i];
+        if(isV6?cfg.isIPV6Avail():cfg.isIPV4Avail())
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void RoutingManager::_PublishPathState()
+{
+    std::vector<bool> isPtP;
+    for(auto const &cfg : pathCfg)
+        isPtP.push_back(cfg->isPtP);
+    std::atomic_store(&pathState,std::shared_ptr<const PathState>(new PathState{activePath4,activePath6,isPtP}));
+}
+
+int RoutingManager::ActivePath(const bool isV6) const
+{
+    auto state=std::atomic_load(&pathState);
+    return isV6?state->active6:state->active4;
+}
+
+void RoutingManager::_UpdateActivePath(const bool isV6, const int prevPath, const uint64_t eventTime)
+{
+    auto activePath=isV6?activePath6:activePath4;
+    if(activePath<0)
+    {
+        //no path available, invalidate all routes immediately
+        if(prevPath>=0)
+            for(auto &shard : shards)
+            {
+                const std::lock_guard<std::mutex> shardLock(shard->lock);
+                _InvalidateActiveRoutes(*shard,!isV6,isV6);
+            }
+        return;
+    }
+    //point nexthop group to the selected path, interface index or type may be changed, all routes using it will be updated by kernel
+    auto groupLost=_ProcessNexthop(isV6);
+    if(prevPath<0)
+        _CheckRestoredPaths(isV6);
+    if(prevPath>=0&&(prevPath!=activePath||groupLost))
+        _MigrateActiveRoutes(isV6,eventTime,groupLost);
+}
+
+//routes restored from snapshot are kept untouched, unless they lead to another interface than the selected one
+void RoutingManager::_CheckRestoredPaths(const bool isV6)
+{
+    if(restoredPaths.empty())
+        return;
+    auto &path=paths[static_cast<size_t>(isV6?activePath6:activePath4)];
+    auto ifIdx=if_nametoindex(path.ifname.c_str());
+    size_t count=0;
+    for(auto it=restoredPaths.begin();it!=restoredPaths.end();)
+    {
+        if(it->first.isV6!=isV6)
+        {
+            ++it;
+            continue;
+        }
+        auto &shard=GetShard(it->first);
+        const std::lock_guard<std::mutex> shardLock(shard.lock);
+        if(it->second!=ifIdx&&shard.activeRoutes.find(it->first)!=shard.activeRoutes.end())
+        {
+            ProcessRoute(it->first,false,true,&nlBatch);
+            count++;
+        }
+        it=restoredPaths.erase(it);
+    }
+    SendBatch(nlBatch);
+    if(count>0)
+        logger.Info()<<"Moved "<<count<<" restored IPv"<<(isV6?6:4)<<" routes to interface "<<path.ifname<<std::endl;
+}
+
+//re-point all active routes to the current path with single batched operation
+void RoutingManager::_MigrateActiveRoutes(const bool isV6, const uint64_t eventTime, const bool groupLost)
+{
+    auto &path=paths[static_cast<size_t>(isV6?activePath6:activePath4)];
+    logger.Warning()<<"Switching IPv"<<(isV6?6:4)<<" routes to interface: "<<path.ifname<<std::endl;
+    size_t count=0;
+    for(auto &shard : shards)
+    {
+        const std::lock_guard<std::mutex> shardLock(shard->lock);
+        for (auto const &el : shard->activeRoutes)
+        {
+            if(el.first.isV6!=isV6)
+                continue;
+            //routes are already re-pointed with nexthop group update, unless kernel removed the group together with them
+            if(nhID==0||groupLost)
+                ProcessRoute(el.first,false,true,&nlBatch);
+            count++;
+        }
+    }
+    SendBatch(nlBatch);
+    auto now=static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    lastFailoverUs=now>eventTime?now-eventTime:0;
+    failoverCount++;
+    logger.Info()<<"Moved "<<count<<" IPv"<<(isV6?6:4)<<" routes to interface "<<path.ifname<<" in "<<static_cast<double>(lastFailoverUs)/1000.0<<" ms since link event"<<std::endl;
+}
+
+void RoutingManager::ProcessFibUpdate(const IFibUpdateMessage &message)
+{
+    const std::lock_guard<std::mutex> lock(fibLock);
+    auto current=fibRoutes.Find(message.dest);
+    //keep routes with all metrics, so the next one takes over when the route with lowest metric is removed
+    auto routes=current==nullptr?FibRouteSet():*current;
+    //replaced or removed route may have covered skipped requests, so they must not be suppressed as duplicates anymore
+    if(message.isAdd)
+    {
+        if(routes.erase(message.metric)>0)
+            fibRemovalGen++;
+        routes.insert({message.metric,FibRoute{message.ifIdx,message.gateway,message.metric}});
+    }
+    else if(routes.erase(message.metric)<1)
+        return;
+    else
+        fibRemovalGen++;
+    if(routes.empty())
+        fibRoutes.Remove(message.dest);
+    else
+        fibRoutes.Insert(message.dest,routes);
+}
+
+void RoutingManager::ManageRoutes(Shard &shard)
+{
+    const std::lock_guard<std::mutex> lock(shard.lock);
+    UpdateCurTime();
+    auto now=MonotonicNs();
+    if(shard.nextRetry<=now)
+    {
+        shard.nextRetry=UINT64_MAX;
+        _ProcessPendingInserts(shard);
+        if(!shard.pendingInserts.empty())
+            _ScheduleRetry(shard,now);
+    }
+    else if(shard.nextPace<=now)
+        _DrainLanes(shard,now);
+    auto budgetExhausted=_ProcessStaleRoutes(shard,now);
+    _PublishActiveIndex(shard);
+    if(budgetExhausted)
+        _ArmTimer(shard,MonotonicNs()+(1+shard.jitter()%EXPIRE_BATCH_PAUSE_MS)*NS_PER_MS,true);
+    else
+        _ArmTimer(shard,_NextDeadline(shard),true);
+}
+
+//schedule processing of pending inserts after management interval, if not scheduled already
+void RoutingManager::_ScheduleRetry(Shard &shard, const uint64_t now)
+{
+    if(shard.nextRetry!=UINT64_MAX)
+        return;
+    shard.nextRetry=(now==0?MonotonicNs():now)+static_cast<uint64_t>(mgIntervalSec)*NS_PER_SEC;
+    _ArmTimer(shard,shard.nextRetry,false);
+}
+
+//nearest of pending inserts retry, paced re-install and the first expire mark with random jitter
+uint64_t RoutingManager::_NextDeadline(Shard &shard)
+{
+    auto deadline=std::min(shard.nextRetry,shard.nextPace);
+    if(!shard.pendingExpires.empty()&&shard.pendingExpires.begin()->first!=UINT64_MAX)
+    {
+        auto expire=shard.pendingExpires.begin()->first*NS_PER_SEC+(shard.jitter()%EXPIRE_JITTER_MS)*NS_PER_MS;
+        if(expire<deadline)
+            deadline=expire;
+    }
+    return deadline;
+}
+
+//set timer to the absolute deadline, UINT64_MAX disarms the timer.
+//without force the timer is only moved to earlier deadline, extra wakeups are harmless
+void RoutingManager::_ArmTimer(Shard &shard, const uint64_t deadline, const bool force)
+{
+    if(shard.timer==-1||(!force&&deadline>=shard.armedDeadline))
+        return;
+    shard.armedDeadline=deadline;
+    itimerspec spec={};
+    if(deadline!=UINT64_MAX)
+    {
+        //zero value disarms the timer, so deadline in the past is set to the minimal one
+        auto value=deadline<1?1:deadline;
+        spec.it_value.tv_sec=static_cast<time_t>(value/NS_PER_SEC);
+        spec.it_value.tv_nsec=static_cast<long>(value%NS_PER_SEC);
+    }
+    if(timerfd_settime(shard.timer,TFD_TIMER_ABSTIME,&spec,nullptr)!=0)
+        logger.Error()<<"Failed to set timerfd: "<<strerror(errno)<<std::endl;
+}
+
+//atomically raise expiration time, returns false if route was removed
+static bool UpdateExpiration(std::atomic<uint64_t> &expiration, const uint64_t value)
+{
+    auto cur=expiration.load();
+    while(true)
+    {
+        if(cur==0)
+            return false;
+        if(cur>=value||expiration.compare_exchange_weak(cur,value))
+            return true;
+    }
+}
+
+//expiration time for the new request of active route, re-resolution interval of the route is updated for ttl policy.
+//does not need any locks, concurrent requests may only skew the interval average a bit
+uint64_t RoutingManager::RequestExpiration(ActiveRoute &route, const unsigned int ttl, const uint64_t now)
+{
+    route.requests++;
+    auto last=route.lastRequest.exchange(now);
+    auto avgInterval=route.avgInterval.load();
+    //requests within the same second are the same resolution seen by different clients
+    if(now>last)
+    {
+        avgInterval=ttlPolicy.UpdateInterval(avgInterval,now-last);
+        route.avgInterval.store(avgInterval);
+    }
+    return now+ttlPolicy.Lifetime(ttl,avgInterval);
+}
+
+//fast path for refreshing already active routes. returns false if route is missing from the last published snapshot
+//or it was removed after that, so the regular path with shard lock must be used
+bool RoutingManager::RefreshActiveRoute(Shard &shard, const IPNetwork &dest, const unsigned int ttl, const uint64_t now)
+{
+    auto index=std::atomic_load(&shard.activeIndex);
+    if(!index)
+        return false;
+    auto it=index->find(dest);
+    if(it==index->end()||!UpdateExpiration(it->second->expiration,RequestExpiration(*it->second,ttl,now)))
+        return false;
+    fastRefreshCount++;
+    return true;
+}
+
+//replace snapshot used by fast path, new active routes will use regular path until that
+void RoutingManager::_PublishActiveIndex(Shard &shard)
+{
+    if(!shard.activeIndexDirty)
+        return;
+    std::atomic_store(&shard.activeIndex,std::shared_ptr<const ActiveRouteMap>(new ActiveRouteMap(shard.activeRoutes)));
+    shard.activeIndexDirty=false;
+}
+
+void RoutingManager::_RemoveActiveRoute(Shard &shard, ActiveRouteMap::iterator it)
+{
+    //mark record as removed, so it cannot be refreshed via outdated snapshot
+    it->second->expiration.store(0);
+    BumpRemovalGeneration(it->first);
+    shard.activeRoutes.erase(it);
+    shard.activeIndexDirty=true;
 }
 
 #define NLMSG_TAIL(nmsg) ((reinterpret_cast<unsigned char*>(nmsg)) + NLMSG_ALIGN((nmsg)->nlmsg_len))
 
-static void AddRTA(struct nlmsghdr *n, unsigned short type, const void *data, size_t dataLen)
+static void AddRTA(struct nlmsghdr *n, const size_t maxLen, unsigned short type, const void *data, size_t dataLen)
 {
     unsigned short rtaLen = static_cast<unsigned short>(RTA_LENGTH(dataLen));
     //check that we have place to add new attribute
-    if ((NLMSG_ALIGN(n->nlmsg_len)+RTA_ALIGN(rtaLen))>sizeof(RouteMsg))
+    if ((NLMSG_ALIGN(n->nlmsg_len)+RTA_ALIGN(rtaLen))>maxLen)
         exit(10); //should not happen if RouteMsg::data is big enough
     //create header for new attribute
     rtattr rtaHDR;
@@ -160,7 +1013,7 @@ static void AddRTA(struct nlmsghdr *n, unsigned short type, const void *data, si
     n->nlmsg_len=NLMSG_ALIGN(n->nlmsg_len)+RTA_ALIGN(rtaLen);
 }
 
-void RoutingManager::_InvalidateActiveRoutes(const bool ipv4, const bool ipv6)
+void RoutingManager::_InvalidateActiveRoutes(Shard &shard, const bool ipv4, const bool ipv6)
 {
     if(!ipv4&&!ipv6)
         return; //nothing to invalidate
@@ -169,70 +1022,196 @@ void RoutingManager::_InvalidateActiveRoutes(const bool ipv4, const bool ipv6)
     if(ipv6)
         logger.Warning()<<"Invalidating active IPv6 routes";
     //dump current routes
-    std::forward_list<IPAddress> targets;
-    for (auto const &el : activeRoutes)
+    std::forward_list<IPNetwork> targets;
+    for (auto const &el : shard.activeRoutes)
         if((ipv6&&el.first.isV6)||(ipv4&&!el.first.isV6))
             targets.push_front(el.first);
     for (auto const &dest : targets)
-        _FinalizeRouteDelete(dest);
+        _FinalizeRouteDelete(shard,dest);
 }
 
-void RoutingManager::_ProcessPendingInserts()
+void RoutingManager::_ProcessPendingInserts(Shard &shard)
 {
     //refuse to do anything if netlink socket is not initialized
-    if(!started)
+    if(!started.load())
         return;
 
-    //if config is unavailable - do nothing
-    auto cfg=ifCfg.Get();
-    if(!cfg.isUp)
-        return;
-
-    auto ipv4Avail=cfg.isIPV4Avail();
-    auto ipv6Avail=cfg.isIPV6Avail();
+    auto ipv4Avail=ActivePath(false)>=0;
+    auto ipv6Avail=ActivePath(true)>=0;
 
     if(ipv4Avail||ipv6Avail)
     {
         //get list of expired pendingRetries
-        std::forward_list<IPAddress> expiredRetries;
-        for (auto const &el : pendingRetries)
+        std::forward_list<IPNetwork> expiredRetries;
+        for (auto const &el : shard.pendingRetries)
             if(el.second>=addRetryCount&&((!el.first.isV6&&ipv4Avail)||(el.first.isV6&&ipv6Avail)))
                 expiredRetries.push_front(el.first);
         //consider all expired retries as activated - we do all we can to install that routes
         for (auto const &el : expiredRetries)
         {
-            logger.Warning()<<"Giving up on receiving route-added confirmation for: "<<el<<std::endl;
-            _FinalizeRouteInsert(el);
+            if(shard.retryHolds.find(el)!=shard.retryHolds.end())
+                logger.Warning()<<"Giving up on route rejected by kernel, killswitch route is kept until expiration for: "<<el<<std::endl;
+            else
+                logger.Warning()<<"Giving up on receiving route-added confirmation for: "<<el<<std::endl;
+            _FinalizeRouteInsert(shard,el);
         }
     }
 
-    //re-add pending routes
-    for (auto const &el : pendingInserts)
+    //start new retry round: queue pending routes, except rejected ones waiting for retry.
+    //routes left from the previous round are queued again, so the round is not extended
+    auto now=MonotonicNs();
+    shard.lanes.Clear(LANE_REINSTALL);
+    shard.ackWaits.clear(); //ACKs from the previous round are either received or lost
+    for (auto const &el : shard.pendingInserts)
     {
         if((!el.first.isV6&&!ipv4Avail)||(el.first.isV6&&!ipv6Avail))
             continue;
+        auto hIT=shard.retryHolds.find(el.first);
+        if(hIT!=shard.retryHolds.end()&&hIT->second.notBefore>now)
+            continue;
+        shard.lanes.Push(LANE_REINSTALL,LaneItem{el.first,0,now});
+    }
+    _DrainLanes(shard,now);
+}
+
+//serve queued route work by priority lanes as allowed by pacer, the rest is scheduled for the time next tokens are available.
+//only routes pushed to kernel are consuming tokens, refreshes of active routes are free
+void RoutingManager::_DrainLanes(Shard &shard, const uint64_t now)
+{
+    shard.nextPace=UINT64_MAX;
+    if(shard.lanes.Size()<1)
+        return;
+    //refreshes need no tokens, new destinations may overdraw the pacer, so bulk work yields to them
+    const unsigned newMask=1u<<LANE_NEW, pacedMask=(1u<<LANE_RETRY)|(1u<<LANE_REINSTALL);
+    auto newGranted=shard.lanes.Size(LANE_NEW)>0?pacer.Take(shard.lanes.Size(LANE_NEW),now,true):0;
+    auto pacedSize=shard.lanes.Size(LANE_RETRY)+shard.lanes.Size(LANE_REINSTALL);
+    auto pacedGranted=pacedSize>0?pacer.Take(pacedSize,now):0;
+    size_t newPushed=0, pacedPushed=0, acks=0;
+    std::vector<unsigned char> batch;
+    while(true)
+    {
+        auto mask=1u<<LANE_REFRESH;
+        if(newPushed<newGranted)
+            mask|=newMask;
+        if(pacedPushed<pacedGranted&&acks<REINSTALL_CHUNK)
+            mask|=pacedMask;
+        if(!shard.lanes.HasItems(mask))
+            break;
+        RequestLane lane;
+        auto item=shard.lanes.Pop(lane,mask,now);
+        if(lane==LANE_REFRESH)
+        {
+            //route may be removed since it was queued, so the request needs new route that must take a token
+            if(shard.activeRoutes.find(item.dest)==shard.activeRoutes.end())
+                shard.lanes.Push(LANE_NEW,item);
+            else
+                _InsertRoute(shard,item.dest,item.expiration,batch);
+            continue;
+        }
+        if(lane!=LANE_REINSTALL)
+        {
+            if(!_InsertRoute(shard,item.dest,item.expiration,batch))
+                continue;
+            if(lane==LANE_NEW)
+                newPushed++;
+            else
+                pacedPushed++;
+            continue;
+        }
+        auto &dest=item.dest;
+        //route may be confirmed, rejected or path may be lost since it was queued
+        if(shard.pendingInserts.find(dest)==shard.pendingInserts.end()||shard.retryHolds.find(dest)!=shard.retryHolds.end()||ActivePath(dest.isV6)<0)
+            continue;
         //(re)push blackhole route to make the killswitch that will work if tracked-interface is down
-        _ProcessRoute(el.first,true,true);
+        ProcessRoute(dest,true,true,&batch);
         //increase retry-counter
-        auto rIT=pendingRetries.find(el.first);
-        auto insertTry=(rIT==pendingRetries.end())?2:rIT->second+1;
-        pendingRetries[el.first]=insertTry;
+        auto rIT=shard.pendingRetries.find(dest);
+        auto insertTry=(rIT==shard.pendingRetries.end())?2:rIT->second+1;
+        shard.pendingRetries[dest]=insertTry;
         //push actual route-rule only if network is running
-        logger.Info()<<"Retrying push routing rule for: "<<el.first<<" try: "<<insertTry<<std::endl;
-        _ProcessRoute(el.first,false,true);
+        logger.Info()<<"Retrying push routing rule for: "<<dest<<" try: "<<insertTry<<std::endl;
+        auto seq=(((ackSeq++)%0xFFFFFFu+1u)<<8)|static_cast<uint32_t>(ShardIndex(dest));
+        shard.ackWaits.emplace(seq,dest);
+        ProcessRoute(dest,false,true,&batch,seq);
+        pacedPushed++;
+        acks++;
     }
+    SendBatch(batch,newPushed+pacedPushed);
+    pacer.Return(newGranted-newPushed+pacedGranted-pacedPushed);
+    if(shard.lanes.Size()<1)
+        return;
+    auto cur=MonotonicNs();
+    pacedSize=shard.lanes.Size(LANE_RETRY)+shard.lanes.Size(LANE_REINSTALL);
+    if(shard.lanes.Size(LANE_NEW)>0)
+        shard.nextPace=pacer.NextAvailable(std::min(shard.lanes.Size(LANE_NEW),static_cast<size_t>(REINSTALL_CHUNK)),cur,true);
+    if(pacedSize>0)
+        shard.nextPace=std::min(shard.nextPace,pacer.NextAvailable(std::min(pacedSize,static_cast<size_t>(REINSTALL_CHUNK)),cur));
+    _ArmTimer(shard,shard.nextPace,false);
 }
 
-void RoutingManager::_FinalizeRouteInsert(const IPAddress& dest)
+//remove the least recently (or least frequently) requested active routes, static routes are never evicted.
+//routes are evicted in groups, so the scan of all active routes is done once per many inserts
+size_t RoutingManager::_EvictRoutes(Shard &shard, std::vector<unsigned char> &batch)
+{
+    std::vector<std::pair<uint64_t,const IPNetwork*>> candidates; //eviction score, route key in activeRoutes
+    candidates.reserve(shard.activeRoutes.size());
+    for(auto const &el : shard.activeRoutes)
+    {
+        auto &route=*el.second;
+        if(route.expiration.load()==UINT64_MAX)
+            continue;
+        auto score=route.lastRequest.load();
+        if(evictLFU)
+            score=(static_cast<uint64_t>(route.requests.load())<<32)|(score&0xFFFFFFFFULL);
+        candidates.emplace_back(score,&el.first);
+    }
+    if(candidates.empty())
+        return 0;
+    auto count=std::min(candidates.size(),std::max(static_cast<size_t>(1),shardRouteLimit/EVICT_BATCH_DIV));
+    std::nth_element(candidates.begin(),candidates.begin()+static_cast<std::ptrdiff_t>(count-1),candidates.end(),
+        [](const std::pair<uint64_t,const IPNetwork*> &a, const std::pair<uint64_t,const IPNetwork*> &b){return a.first<b.first;});
+    for(size_t i=0;i<count;++i)
+    {
+        const IPNetwork dest(*candidates[i].second);
+        logger.Info()<<"Evicting routing rule for: "<<dest<<std::endl;
+        ProcessRoute(dest,false,false,&batch);
+        ProcessRoute(dest,true,false,&batch);
+        _RemoveActiveRoute(shard,shard.activeRoutes.find(dest));
+    }
+    shard.evictedCount+=count;
+    return count;
+}
+
+//log alert once when route count crosses alert level, and clear it when route count drops noticeably below
+void RoutingManager::_CheckRouteLimit(Shard &shard)
+{
+    if(shardRouteLimit<1)
+        return;
+    auto count=shard.activeRoutes.size()+shard.pendingInserts.size();
+    if(!shard.fillAlert&&count>=alertLevel)
+    {
+        shard.fillAlert=true;
+        shard.alertCount++;
+        logger.Warning()<<"Route table fill is above alert level: "<<count<<" of "<<shardRouteLimit<<" routes in shard"<<std::endl;
+    }
+    else if(shard.fillAlert&&count<alertLevel*ALERT_CLEAR_PCT/100)
+    {
+        shard.fillAlert=false;
+        logger.Info()<<"Route table fill is back to normal: "<<count<<" of "<<shardRouteLimit<<" routes"<<std::endl;
+    }
+}
+
+void RoutingManager::_FinalizeRouteInsert(Shard &shard, const IPNetwork& dest)
 {
     //if there are no pendingInserts record for this IP, show warning
-    uint64_t expiration=curTime.load()+extraTTL;
-    auto pIT=pendingInserts.find(dest);
-    if(pIT==pendingInserts.end())
+    auto now=UpdateCurTime();
+    auto expiration=now+ttlPolicy.Lifetime(0,0);
+    auto pIT=shard.pendingInserts.find(dest);
+    if(pIT==shard.pendingInserts.end())
     {
         //try active route
-        auto aIT=activeRoutes.find(dest);
-        if(aIT!=activeRoutes.end())
+        auto aIT=shard.activeRoutes.find(dest);
+        if(aIT!=shard.activeRoutes.end())
         {
             logger.Warning()<<"Ignoring modification of active route expiration time for: "<<dest<<std::endl;
             return;
@@ -243,63 +1222,137 @@ void RoutingManager::_FinalizeRouteInsert(const IPAddress& dest)
     else
     {
         expiration=pIT->second;
-        pendingInserts.erase(pIT);
-        pendingRetries.erase(dest);
+        shard.pendingInserts.erase(pIT);
+        shard.pendingRetries.erase(dest);
+        shard.retryHolds.erase(dest);
     }
-    activeRoutes[dest]=expiration; //move rule to activeRoutes
-    pendingExpires.insert({expiration,dest}); //add pending insert record, for route-management task
+    shard.activeRoutes[dest]=std::make_shared<ActiveRoute>(expiration,now); //move rule to activeRoutes
+    shard.activeIndexDirty=true;
+    shard.pendingExpires.insert({expiration,dest}); //add pending insert record, for route-management task
+    if(expiration!=UINT64_MAX)
+        _ArmTimer(shard,expiration*NS_PER_SEC+(shard.jitter()%EXPIRE_JITTER_MS)*NS_PER_MS,false);
 }
 
-void RoutingManager::_FinalizeRouteDelete(const IPAddress &dest)
+void RoutingManager::_FinalizeRouteDelete(Shard &shard, const IPNetwork &dest)
 {
     //check for unexpected route-removal
-    auto aIT=activeRoutes.find(dest);
-    if(aIT!=activeRoutes.end())
+    auto aIT=shard.activeRoutes.find(dest);
+    if(aIT!=shard.activeRoutes.end())
     {
         logger.Warning()<<"Pending re-add for unexpectedly removed route for: "<<dest<<std::endl;
-        pendingInserts.insert({dest,aIT->second});
-        pendingRetries.erase(dest);
-        activeRoutes.erase(aIT);
+        shard.pendingInserts.insert({dest,aIT->second->expiration.load()});
+        shard.pendingRetries.erase(dest);
+        shard.retryHolds.erase(dest);
+        _RemoveActiveRoute(shard,aIT);
+        _ScheduleRetry(shard,0);
+    }
+}
+
+//apply retry policy to pending route rejected by kernel
+void RoutingManager::_RejectRouteInsert(Shard &shard, const IPNetwork &dest, const int error, const std::string &reason)
+{
+    //reply for outdated request, route is already confirmed or removed
+    if(shard.pendingInserts.find(dest)==shard.pendingInserts.end())
+        return;
+    auto &hold=shard.retryHolds[dest];
+    hold.rejects++;
+    auto policy=GetRetryPolicy(error,nhID>0);
+    if(policy==RETRY_GIVE_UP)
+    {
+        shard.rejectGiveUps++;
+        logger.Warning()<<"Giving up on route rejected by kernel, killswitch route is kept until expiration for: "<<dest<<": "<<reason<<std::endl;
+        _FinalizeRouteInsert(shard,dest);
+        return;
+    }
+    if(policy==RETRY_ON_NETDEV)
+    {
+        shard.rejectNetDevWaits++;
+        hold.notBefore=UINT64_MAX;
+        logger.Warning()<<"Route rejected by kernel, waiting for interface state change for: "<<dest<<": "<<reason<<std::endl;
+        return;
     }
+    //exponential backoff with random jitter up to a half of delay, so rejected routes are not retried at once
+    shard.rejectBackoffs++;
+    auto delayMs=static_cast<uint64_t>(mgIntervalSec)*1000ULL<<std::min(hold.rejects-1,RETRY_BACKOFF_MAX_SHIFT);
+    delayMs+=shard.jitter()%(delayMs/2+1);
+    hold.notBefore=MonotonicNs()+delayMs*NS_PER_MS;
+    logger.Warning()<<"Route rejected by kernel, retrying in "<<delayMs<<" ms for: "<<dest<<": "<<reason<<std::endl;
+    _ScheduleRetry(shard,0);
 }
 
-void RoutingManager::_ProcessRoute(const IPAddress &ip, const bool blackhole, const bool isAddRequest)
+void RoutingManager::ProcessRoute(const IPNetwork &dest, const bool blackhole, const bool isAddRequest, std::vector<unsigned char> *batch, const uint32_t seq)
 {
+    //path for non-blackhole routes, route removal may be performed without it
+    auto state=std::atomic_load(&pathState);
+    auto pathIdx=dest.isV6?state->active6:state->active4;
+    auto path=pathIdx<0?nullptr:&paths[static_cast<size_t>(pathIdx)];
+
     RouteMsg msg={};
 
     msg.nl.nlmsg_len=NLMSG_LENGTH(sizeof(rtmsg));
     msg.nl.nlmsg_flags=isAddRequest?(NLM_F_REQUEST|NLM_F_CREATE|NLM_F_REPLACE):NLM_F_REQUEST;
     msg.nl.nlmsg_type=isAddRequest?RTM_NEWROUTE:RTM_DELROUTE;
+    if(seq!=0)
+    {
+        msg.nl.nlmsg_flags|=NLM_F_ACK;
+        msg.nl.nlmsg_seq=seq;
+    }
 
     msg.rt.rtm_table=RT_TABLE_MAIN;
     msg.rt.rtm_scope=RT_SCOPE_UNIVERSE;
     msg.rt.rtm_type=blackhole?RTN_BLACKHOLE:RTN_UNICAST;
     //msg.rt.rtm_flags=RTM_F_NOTIFY;
     msg.rt.rtm_protocol=RTPROT_STATIC; //TODO: check do we really need this
-    msg.rt.rtm_dst_len=ip.isV6?128:32;
-    msg.rt.rtm_family=ip.isV6?AF_INET6:AF_INET;
+    msg.rt.rtm_dst_len=static_cast<unsigned char>(dest.prefixLen);
+    msg.rt.rtm_family=dest.isV6?AF_INET6:AF_INET;
 
     //add destination
-    AddRTA(&msg.nl,RTA_DST,ip.RawData(),ip.isV6?IPV6_ADDR_LEN:IPV4_ADDR_LEN);
+    AddRTA(&msg.nl,sizeof(msg),RTA_DST,dest.ip.RawData(),dest.isV6?IPV6_ADDR_LEN:IPV4_ADDR_LEN);
 
-    if(!blackhole)
+    if(!blackhole && nhID>0)
+    {
+#ifdef HAVE_LINUX_NEXTHOP_H
+        //use nexthop object instead of interface and gateway
+        uint32_t routeNhID=dest.isV6?nhID+1:nhID;
+        AddRTA(&msg.nl,sizeof(msg),RTA_NH_ID,&routeNhID,sizeof(routeNhID));
+#endif
+    }
+    else if(!blackhole && path!=nullptr)
     {
         //add interface
-        auto ifIdx=if_nametoindex(ifname.c_str());
-        AddRTA(&msg.nl,RTA_OIF,&ifIdx,sizeof(ifIdx));
+        auto ifIdx=if_nametoindex(path->ifname.c_str());
+        AddRTA(&msg.nl,sizeof(msg),RTA_OIF,&ifIdx,sizeof(ifIdx));
     }
 
     //set metric/priority
     int prio=blackhole?ksMetric:metric;
-    AddRTA(&msg.nl,RTA_PRIORITY,&prio,sizeof(prio));
+    AddRTA(&msg.nl,sizeof(msg),RTA_PRIORITY,&prio,sizeof(prio));
 
     //add gateway
-    if(!blackhole && !ifCfg.Get().isPtP)
+    if(!blackhole && nhID==0 && path!=nullptr && !state->isPtP[static_cast<size_t>(pathIdx)])
     {
-        if(gateway4.isValid && !ip.isV6)
-            AddRTA(&msg.nl,RTA_GATEWAY,gateway4.RawData(),IPV4_ADDR_LEN);
-        if(gateway6.isValid && ip.isV6)
-            AddRTA(&msg.nl,RTA_GATEWAY,gateway6.RawData(),IPV6_ADDR_LEN);
+        auto &gateway=path->Gateway(dest.isV6);
+        if(gateway.isValid)
+            AddRTA(&msg.nl,sizeof(msg),RTA_GATEWAY,gateway.RawData(),dest.isV6?IPV6_ADDR_LEN:IPV4_ADDR_LEN);
+    }
+
+    //add nested kernel metrics
+    if(!blackhole && isAddRequest && !routeMetrics.IsEmpty())
+    {
+        unsigned char metrics[64];
+        auto metricsLen=routeMetrics.Encode(metrics,sizeof(metrics));
+        if(metricsLen>0)
+            AddRTA(&msg.nl,sizeof(msg),RTA_METRICS,metrics,metricsLen);
+    }
+
+    //append message to the batch, it will be sent later with SendBatch
+    if(batch!=nullptr)
+    {
+        if(batch->size()+NLMSG_ALIGN(msg.nl.nlmsg_len)>NL_BATCH_SIZE)
+            SendBatch(*batch);
+        auto raw=reinterpret_cast<const unsigned char*>(&msg);
+        batch->insert(batch->end(),raw,raw+NLMSG_ALIGN(msg.nl.nlmsg_len));
+        return;
     }
 
     //send netlink message:
@@ -307,105 +1360,522 @@ void RoutingManager::_ProcessRoute(const IPAddress &ip, const bool blackhole, co
         logger.Error()<<"Failed to send route via netlink: "<<strerror(errno)<<std::endl;
 }
 
-void RoutingManager::_ProcessStaleRoutes()
+void RoutingManager::SendBatch(std::vector<unsigned char> &batch, const size_t routes)
 {
-    //get pendingExpires length
-    auto expCnt=pendingExpires.size();
-    if(expCnt<1)
+    if(batch.empty())
         return;
-    auto remCnt=static_cast<int>(static_cast<float>(expCnt)/100.0f*static_cast<float>(mgPercent));
-    if(remCnt<1)
-        remCnt=1;
-    auto curMark=curTime.load();
-    while(remCnt>0)
+    //kernel processes netlink requests synchronously, so send duration is the time rtnl lock was held by them
+    auto start=MonotonicNs();
+    if(send(sock,batch.data(),batch.size(),0)!=static_cast<ssize_t>(batch.size()))
+        logger.Error()<<"Failed to send batch of routes via netlink: "<<strerror(errno)<<std::endl;
+    else
+        pacer.Calibrate(routes,MonotonicNs()-start);
+    batch.clear();
+}
+
+#ifdef HAVE_LINUX_NEXTHOP_H
+//kernel state of nexthop object, as reported by RTM_GETNEXTHOP
+struct NexthopState
+{
+    uint32_t oif=0;
+    uint32_t member=0; //first member of the group
+    unsigned char gateway[IPV6_ADDR_LEN]={};
+    size_t gatewayLen=0;
+};
+
+//send single request via temporary netlink socket and wait for kernel response, returns 0 or errno reported by kernel.
+//nexthop reported in response to get request is stored to state
+static int NetlinkRequest(nlmsghdr *msg, NexthopState *state=nullptr)
+{
+    auto reqSock=socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if(reqSock==-1)
+        return errno;
+    msg->nlmsg_flags|=NLM_F_ACK;
+    int result=0;
+    if(send(reqSock,msg,msg->nlmsg_len,0)!=static_cast<ssize_t>(msg->nlmsg_len))
+        result=errno;
+    else
     {
-        auto tIT=pendingExpires.begin();
-        if(curMark<tIT->first)
+        unsigned char buf[4096];
+        auto len=recv(reqSock,buf,sizeof(buf),0);
+        auto resp=reinterpret_cast<nlmsghdr*>(buf);
+        if(len<0)
+            result=errno;
+        else if(state!=nullptr&&len>=static_cast<ssize_t>(NLMSG_LENGTH(sizeof(nhmsg)))&&resp->nlmsg_type==RTM_NEWNEXTHOP&&resp->nlmsg_len<=static_cast<size_t>(len))
         {
-            //logger.Info()<<"time diff for next mark: "<<tIT->first-curMark<<std::endl;
-            return;
+            auto rtl=static_cast<int>(resp->nlmsg_len-NLMSG_LENGTH(sizeof(nhmsg)));
+            for(auto rth=reinterpret_cast<rtattr*>(buf+NLMSG_LENGTH(sizeof(nhmsg)));RTA_OK(rth,rtl);rth=RTA_NEXT(rth,rtl))
+            {
+                auto dataLen=RTA_PAYLOAD(rth);
+                if(rth->rta_type==NHA_OIF&&dataLen>=sizeof(uint32_t))
+                    memcpy(&state->oif,RTA_DATA(rth),sizeof(uint32_t));
+                else if(rth->rta_type==NHA_GROUP&&dataLen>=sizeof(nexthop_grp))
+                    memcpy(&state->member,RTA_DATA(rth),sizeof(uint32_t));
+                else if(rth->rta_type==NHA_GATEWAY&&dataLen<=sizeof(state->gateway))
+                {
+                    memcpy(state->gateway,RTA_DATA(rth),dataLen);
+                    state->gatewayLen=dataLen;
+                }
+            }
         }
+        else if(len<static_cast<ssize_t>(NLMSG_HDRLEN+sizeof(nlmsgerr))||resp->nlmsg_type!=NLMSG_ERROR)
+            result=EPROTO;
+        else
+            result=-reinterpret_cast<nlmsgerr*>(buf+NLMSG_HDRLEN)->error;
+    }
+    close(reqSock);
+    return result;
+}
+
+static int GetNexthop(const uint32_t id, NexthopState &state)
+{
+    NexthopMsg msg={};
+    msg.nl.nlmsg_len=NLMSG_LENGTH(sizeof(nhmsg));
+    msg.nl.nlmsg_flags=NLM_F_REQUEST;
+    msg.nl.nlmsg_type=RTM_GETNEXTHOP;
+    AddRTA(&msg.nl,sizeof(msg),NHA_ID,&id,sizeof(id));
+    return NetlinkRequest(&msg.nl,&state);
+}
+#endif
+
+//routes are pointed to the nexthop group, and the group is pointed to the nexthop of the active path.
+//returns true if the group was missing: kernel removes the group together with all routes using it when its only member is flushed on carrier loss
+bool RoutingManager::_ProcessNexthop(const bool isV6)
+{
+#ifdef HAVE_LINUX_NEXTHOP_H
+    auto pathIdx=isV6?activePath6:activePath4;
+    if(nhID==0||!started.load()||pathIdx<0)
+        return false;
+    auto &path=paths[static_cast<size_t>(pathIdx)];
+
+    //create or update interface nexthop
+    NexthopMsg msg={};
+    msg.nl.nlmsg_len=NLMSG_LENGTH(sizeof(nhmsg));
+    msg.nl.nlmsg_flags=NLM_F_REQUEST|NLM_F_CREATE|NLM_F_REPLACE;
+    msg.nl.nlmsg_type=RTM_NEWNEXTHOP;
+    msg.nh.nh_family=isV6?AF_INET6:AF_INET;
+    msg.nh.nh_protocol=RTPROT_STATIC;
+
+    uint32_t memberID=nhID+2+2*static_cast<uint32_t>(pathIdx)+(isV6?1:0);
+    AddRTA(&msg.nl,sizeof(msg),NHA_ID,&memberID,sizeof(memberID));
+
+    auto ifIdx=if_nametoindex(path.ifname.c_str());
+    AddRTA(&msg.nl,sizeof(msg),NHA_OIF,&ifIdx,sizeof(ifIdx));
+
+    auto &gateway=path.Gateway(isV6);
+    size_t gatewayLen=0;
+    if(gateway.isValid && !pathCfg[static_cast<size_t>(pathIdx)]->isPtP)
+    {
+        gatewayLen=isV6?IPV6_ADDR_LEN:IPV4_ADDR_LEN;
+        AddRTA(&msg.nl,sizeof(msg),NHA_GATEWAY,gateway.RawData(),gatewayLen);
+    }
+
+    //every replace makes kernel to notify about all routes using the nexthop, so objects that are already up to date are left alone
+    NexthopState current;
+    auto error=GetNexthop(memberID,current);
+    if(error!=0||current.oif!=ifIdx||current.gatewayLen!=gatewayLen||memcmp(current.gateway,gateway.RawData(),gatewayLen)!=0)
+        error=NetlinkRequest(&msg.nl);
+    if(error!=0)
+    {
+        logger.Error()<<"Failed to update "<<(isV6?"IPv6":"IPv4")<<" nexthop with id: "<<memberID<<": "<<strerror(error)<<std::endl;
+        return false;
+    }
+
+    //point the group to it, group must be replaced in place to keep routes using it
+    msg={};
+    msg.nl.nlmsg_len=NLMSG_LENGTH(sizeof(nhmsg));
+    msg.nl.nlmsg_flags=NLM_F_REQUEST|NLM_F_REPLACE;
+    msg.nl.nlmsg_type=RTM_NEWNEXTHOP;
+    msg.nh.nh_family=AF_UNSPEC;
+    msg.nh.nh_protocol=RTPROT_STATIC;
+
+    uint32_t id=isV6?nhID+1:nhID;
+    AddRTA(&msg.nl,sizeof(msg),NHA_ID,&id,sizeof(id));
+    nexthop_grp member={};
+    member.id=memberID;
+    AddRTA(&msg.nl,sizeof(msg),NHA_GROUP,&member,sizeof(member));
+
+    current=NexthopState();
+    if(GetNexthop(id,current)==0&&current.member==memberID)
+        return false;
+    logger.Info()<<"Updating "<<(isV6?"IPv6":"IPv4")<<" nexthop group with id: "<<id<<" to interface: "<<path.ifname<<std::endl;
+    auto groupLost=false;
+    error=NetlinkRequest(&msg.nl);
+    if(error==ENOENT)
+    {
+        logger.Info()<<"Creating "<<(isV6?"IPv6":"IPv4")<<" nexthop group with id: "<<id<<std::endl;
+        msg.nl.nlmsg_flags|=NLM_F_CREATE;
+        groupLost=true;
+        error=NetlinkRequest(&msg.nl);
+    }
+    if(error!=0)
+        logger.Error()<<"Failed to update nexthop group via netlink: "<<strerror(error)<<std::endl;
+    return groupLost;
+#else
+    (void)isV6;
+    return false;
+#endif
+}
+
+//process reached expire marks until time budget is exhausted, returns true if some reached marks left unprocessed
+bool RoutingManager::_ProcessStaleRoutes(Shard &shard, const uint64_t now)
+{
+    auto curMark=now/NS_PER_SEC;
+    auto budgetEnd=now+static_cast<uint64_t>(mgBudgetMs)*NS_PER_MS;
+    size_t processed=0;
+    while(!shard.pendingExpires.empty())
+    {
+        auto tIT=shard.pendingExpires.begin();
+        if(curMark<tIT->first)
+            return false;
+        //check budget periodically, clock reading is not free
+        if((++processed%16)==0&&MonotonicNs()>=budgetEnd)
+            return true;
         logger.Info()<<"Evaluating ip: "<<tIT->second<<" with expire mark: "<<tIT->first<<" current time mark: "<<curMark<<std::endl;
         //check time mark is valid
-        auto aIT=activeRoutes.find(tIT->second);
-        if(aIT==activeRoutes.end()||aIT->second>tIT->first)
+        auto aIT=shard.activeRoutes.find(tIT->second);
+        if(aIT==shard.activeRoutes.end()||aIT->second->expireMark!=tIT->first)
             logger.Info()<<"Removing invalid expire mark: "<<tIT->first<<" for ip: "<<tIT->second<<std::endl;
         else
         {
-            _ProcessRoute(aIT->first,false,false); //commence route removal
-            logger.Info()<<"Removing expired routing rule for: "<<aIT->first<<" with expite mark: "<<aIT->second<<std::endl;
-            _ProcessRoute(aIT->first,true,false); //commence blackhole route removal
-            activeRoutes.erase(aIT); //remove from active routes
+            //expiration time may be refreshed concurrently by fast path, so route is removed only if it is not changed
+            auto expiration=aIT->second->expiration.load();
+            if(expiration>curMark||!aIT->second->expiration.compare_exchange_strong(expiration,0))
+            {
+                aIT->second->expireMark=aIT->second->expiration.load();
+                shard.pendingExpires.insert({aIT->second->expireMark,aIT->first});
+            }
+            else
+            {
+                ProcessRoute(aIT->first,false,false); //commence route removal
+                logger.Info()<<"Removing expired routing rule for: "<<aIT->first<<" with expite mark: "<<expiration<<std::endl;
+                ProcessRoute(aIT->first,true,false); //commence blackhole route removal
+                //lifetime statistics for ttl policy tuning
+                shard.lifetimes[TtlPolicy::HistogramBucket(curMark>aIT->second->added?curMark-aIT->second->added:0)]++;
+                if(aIT->second->avgInterval.load()<1)
+                    shard.expiredOneOff++;
+                _RemoveActiveRoute(shard,aIT); //remove from active routes
+                //expiry lag: how far behind the schedule route was removed
+                auto lag=MonotonicNs()-expiration*NS_PER_SEC;
+                shard.expiredCount++;
+                shard.expiryLagSum+=lag;
+                if(lag>shard.expiryLagMax)
+                    shard.expiryLagMax=lag;
+            }
         }
         //erase pending element
-        pendingExpires.erase(tIT);
-        remCnt--;
+        shard.pendingExpires.erase(tIT);
     }
+    return false;
 }
 
-void RoutingManager::InsertRoute(const IPAddress& dest, unsigned int ttl)
+//find existing route that makes route to dest redundant:
+//route must cover dest, lead to the active path interface and use the same gateway, or have no gateway at all (connected network).
+//default route is never considered as covering one, we still need route to dest for the killswitch to work.
+bool RoutingManager::FindCoveringRoute(const IPNetwork &dest)
 {
-    const std::lock_guard<std::mutex> lock(opLock);
-    auto expirationTime=curTime.load()+ttl+extraTTL;
+    if(!fibFilter)
+        return false;
+    auto pathIdx=ActivePath(dest.isV6);
+    if(pathIdx<0)
+        return false;
+    auto &path=paths[static_cast<size_t>(pathIdx)];
+    const std::lock_guard<std::mutex> lock(fibLock);
+    auto match=fibRoutes.Lookup(dest.ip);
+    if(match==nullptr||match->first.prefixLen<1||!match->first.Contains(dest))
+        return false;
+    auto &route=match->second.begin()->second;
+    auto ifIdx=if_nametoindex(path.ifname.c_str());
+    if(ifIdx==0||route.ifIdx!=ifIdx)
+        return false;
+    auto &gateway=path.Gateway(dest.isV6);
+    if(route.gateway.isValid&&(!gateway.isValid||!(route.gateway==gateway)))
+        return false;
+    fibSkipped++;
+    logger.Info()<<"Skipping route-rule for: "<<dest<<", destination is already covered by: "<<match->first<<std::endl;
+    return true;
+}
+
+//sort batch items by shard, so every shard is locked only once per batch. order of items for the same shard is kept
+static void GroupByShard(std::vector<std::pair<size_t,size_t>> &items)
+{
+    std::stable_sort(items.begin(),items.end(),[](const std::pair<size_t,size_t> &a, const std::pair<size_t,size_t> &b){return a.first<b.first;});
+}
+
+//process all route requests from single dnsdist message: active routes are refreshed without locks,
+//other requests are queued by priority with single lock per shard and served as allowed by pacer
+void RoutingManager::InsertRoutes(const std::vector<RouteRequest> &requests)
+{
+    requestBatches++;
+    requestCount+=requests.size();
+    auto now=UpdateCurTime();
+    std::vector<std::pair<size_t,size_t>> items; //shard index, request index
+    for(size_t i=0;i<requests.size();++i)
+    {
+        auto &ip=requests[i].ip;
+        //map answer to the covering prefix, host route by default
+        const IPNetwork dest(ip,ip.isV6?prefixLen6:prefixLen4);
+        if(!RefreshActiveRoute(GetShard(dest),dest,requests[i].ttl,now))
+            items.emplace_back(ShardIndex(dest),i);
+    }
+    GroupByShard(items);
+    auto queuedAt=MonotonicNs();
+    for(size_t pos=0;pos<items.size();)
+    {
+        auto shardIdx=items[pos].first;
+        auto &shard=*shards[shardIdx];
+        const std::lock_guard<std::mutex> lock(shard.lock);
+        for(;pos<items.size()&&items[pos].first==shardIdx;++pos)
+        {
+            auto &request=requests[items[pos].second];
+            const IPNetwork dest(request.ip,request.ip.isV6?prefixLen6:prefixLen4);
+            //under overload destinations without route are served before retries and refreshes
+            auto aIT=shard.activeRoutes.find(dest);
+            if(aIT!=shard.activeRoutes.end())
+                shard.lanes.Push(LANE_REFRESH,LaneItem{dest,RequestExpiration(*aIT->second,request.ttl,now),queuedAt});
+            else
+                shard.lanes.Push(shard.pendingInserts.find(dest)!=shard.pendingInserts.end()?LANE_RETRY:LANE_NEW,LaneItem{dest,now+ttlPolicy.Lifetime(request.ttl,0),queuedAt});
+        }
+        _DrainLanes(shard,queuedAt);
+    }
+}
 
+bool RoutingManager::_InsertRoute(Shard &shard, const IPNetwork &dest, const uint64_t expirationTime, std::vector<unsigned char> &batch)
+{
     //check, maybe we already have this route as active
-    auto aIT=activeRoutes.find(dest);
-    if(aIT!=activeRoutes.end())
+    auto aIT=shard.activeRoutes.find(dest);
+    if(aIT!=shard.activeRoutes.end())
     {
         //if so - update expiration time, and return
-        if(aIT->second<expirationTime)
+        if(aIT->second->expiration.load()<expirationTime)
         {
             logger.Info()<<"Already installed route-rule detected, updating expiration time: "<<expirationTime<<" for: "<<dest<<std::endl;
-            activeRoutes[dest]=expirationTime;
-            pendingExpires.insert({expirationTime,dest});
+            UpdateExpiration(aIT->second->expiration,expirationTime);
         }
         else
             logger.Warning()<<"Already installed route-rule detected for: "<<dest<<std::endl;
-        return;
+        return false;
+    }
+
+    //check, maybe destination is already reachable via tracked interface
+    auto isNew=shard.pendingInserts.find(dest)==shard.pendingInserts.end();
+    if(isNew&&FindCoveringRoute(dest))
+        return false;
+
+    //make room for the new route, deletes are sent with the same batch
+    if(isNew&&shardRouteLimit>0&&shard.activeRoutes.size()+shard.pendingInserts.size()>=shardRouteLimit&&_EvictRoutes(shard,batch)<1)
+    {
+        shard.refusedCount++;
+        BumpRemovalGeneration(dest);
+        logger.Warning()<<"Route limit reached and there is no route to evict, ignoring request for: "<<dest<<std::endl;
+        return false;
     }
 
     //commence netlink operations only if socket is properly started
-    if(started)
+    auto pushed=false;
+    if(started.load())
     {
         //push blackhole route regardless of network state
-        _ProcessRoute(dest,true,true);
-        auto cfg=ifCfg.Get();
-        //push new route immediately, only if network is up and running
-        if(cfg.isUp&&((!dest.isV6&&cfg.isIPV4Avail())||(dest.isV6&&cfg.isIPV6Avail())))
+        ProcessRoute(dest,true,true,&batch);
+        //push new route immediately, only if network is up and running and route is not held after rejection
+        if(ActivePath(dest.isV6)>=0&&shard.retryHolds.find(dest)==shard.retryHolds.end())
         {
             logger.Info()<<"Pushing new routing rule for: "<<dest<<" with expiration time:"<<expirationTime<<std::endl;
-            _ProcessRoute(dest,false,true);
+            ProcessRoute(dest,false,true,&batch);
+            pushed=true;
         }
         else
             logger.Info()<<"Delaying push new routing rule for: "<<dest<<" with expiration time:"<<expirationTime<<std::endl;
     }
 
     //add new pending route, or update it's expiration time
-    auto pIT=pendingInserts.find(dest);
-    if(pIT==pendingInserts.end()||pIT->second<expirationTime)
+    auto pIT=shard.pendingInserts.find(dest);
+    if(pIT==shard.pendingInserts.end()||pIT->second<expirationTime)
     {
-        pendingInserts[dest]=expirationTime;
-        pendingRetries.erase(dest);//cleanup retry counter
+        shard.pendingInserts[dest]=expirationTime;
+        shard.pendingRetries.erase(dest);//cleanup retry counter
+        _ScheduleRetry(shard,0);
     }
+    if(isNew)
+        _CheckRouteLimit(shard);
+    return pushed;
 }
 
-void RoutingManager::ConfirmRouteAdd(const IPAddress &dest)
+//process route added and removed notifications with single lock per shard
+void RoutingManager::ConfirmRoutes(const std::vector<RouteConfirmation> &confirmations)
+{
+    confirmBatches++;
+    confirmCount+=confirmations.size();
+    std::vector<std::pair<size_t,size_t>> items; //shard index, confirmation index
+    for(size_t i=0;i<confirmations.size();++i)
+        items.emplace_back(ShardIndex(confirmations[i].dest),i);
+    GroupByShard(items);
+    for(size_t pos=0;pos<items.size();)
+    {
+        auto shardIdx=items[pos].first;
+        auto &shard=*shards[shardIdx];
+        const std::lock_guard<std::mutex> lock(shard.lock);
+        for(;pos<items.size()&&items[pos].first==shardIdx;++pos)
+        {
+            auto &confirmation=confirmations[items[pos].second];
+            if(confirmation.isAdd)
+                _ConfirmRouteAdd(shard,confirmation.dest,confirmation.ifname);
+            else
+                _ConfirmRouteDel(shard,confirmation.dest,confirmation.ifname);
+        }
+    }
+}
+
+//route-removed notifications were lost by the tracker: active routes missing from kernel are handled as unexpectedly removed.
+//all shards are locked during the dump, so routes confirmed meanwhile are not mistaken for missing ones
+void RoutingManager::ReconcileRoutes(const std::string &ifname)
 {
     const std::lock_guard<std::mutex> lock(opLock);
+    std::vector<std::unique_lock<std::mutex>> shardLocks;
+    for(auto &shard : shards)
+        shardLocks.emplace_back(shard->lock);
+    std::unordered_map<IPNetwork,unsigned int> unicast;
+    std::unordered_set<IPNetwork> blackholes;
+    if(!DumpOwnRoutes(unicast,blackholes))
+    {
+        logger.Warning()<<"Failed to reconcile active routes with kernel after "<<ifname<<" resync"<<std::endl;
+        return;
+    }
+    size_t missing=0;
+    for(auto &shard : shards)
+    {
+        std::vector<IPNetwork> lost;
+        for(auto const &el : shard->activeRoutes)
+            if(unicast.find(el.first)==unicast.end())
+                lost.push_back(el.first);
+        for(auto const &dest : lost)
+            _FinalizeRouteDelete(*shard,dest);
+        missing+=lost.size();
+    }
+    logger.Info()<<"Active routes reconciled with kernel after "<<ifname<<" resync, missing routes: "<<missing<<std::endl;
+}
+
+void RoutingManager::_ConfirmRouteAdd(Shard &shard, const IPNetwork &dest, const std::string &ifname)
+{
+    auto pathIdx=ActivePath(dest.isV6);
+    if(!ifname.empty()&&(pathIdx<0||paths[static_cast<size_t>(pathIdx)].ifname!=ifname))
+    {
+        logger.Info()<<"Ignoring route-added confirmation via inactive interface "<<ifname<<" for: "<<dest<<std::endl;
+        return;
+    }
+    //confirmation for active route, received after moving it to another path
+    if(shard.activeRoutes.find(dest)!=shard.activeRoutes.end())
+        return;
     logger.Info()<<"Processing route-added confirmation for: "<<dest<<std::endl;
-    _FinalizeRouteInsert(dest);
+    _FinalizeRouteInsert(shard,dest);
 }
 
-void RoutingManager::ConfirmRouteDel(const IPAddress &dest)
+void RoutingManager::_ConfirmRouteDel(Shard &shard, const IPNetwork &dest, const std::string &ifname)
 {
-    const std::lock_guard<std::mutex> lock(opLock);
+    //route removed from the old path after switching to another one
+    auto pathIdx=ActivePath(dest.isV6);
+    if(!ifname.empty()&&pathIdx>=0&&paths[static_cast<size_t>(pathIdx)].ifname!=ifname)
+        return;
     logger.Info()<<"Processing route-removed confirmation for: "<<dest<<std::endl;
-    _FinalizeRouteDelete(dest);
+    _FinalizeRouteDelete(shard,dest);
+}
+
+void RoutingManager::LogStats()
+{
+    const std::lock_guard<std::mutex> lock(opLock);
+    size_t active=0, pending=0, marks=0, held=0;
+    uint64_t expired=0, lagSum=0, lagMax=0, backoffs=0, netDevWaits=0, giveUps=0, oneOff=0;
+    uint64_t lifetimes[TtlPolicy::histogramSize]={};
+    uint64_t evicted=0, refused=0, alerts=0;
+    for(auto &shard : shards)
+    {
+        const std::lock_guard<std::mutex> shardLock(shard->lock);
+        active+=shard->activeRoutes.size();
+        pending+=shard->pendingInserts.size();
+        marks+=shard->pendingExpires.size();
+        held+=shard->retryHolds.size();
+        backoffs+=shard->rejectBackoffs;
+        netDevWaits+=shard->rejectNetDevWaits;
+        giveUps+=shard->rejectGiveUps;
+        expired+=shard->expiredCount;
+        lagSum+=shard->expiryLagSum;
+        if(shard->expiryLagMax>lagMax)
+            lagMax=shard->expiryLagMax;
+        oneOff+=shard->expiredOneOff;
+        for(size_t i=0;i<TtlPolicy::histogramSize;++i)
+            lifetimes[i]+=shard->lifetimes[i];
+        evicted+=shard->evictedCount;
+        refused+=shard->refusedCount;
+        alerts+=shard->alertCount;
+    }
+    logger.Info()<<"Routes: active="<<active<<"; pending="<<pending<<"; expire marks="<<marks<<"; lock-free refreshes="<<fastRefreshCount.load()<<"; shards="<<shardCount<<std::endl;
+    auto reqBatches=requestBatches.load();
+    auto cfmBatches=confirmBatches.load();
+    logger.Info()<<"Batches: route requests="<<requestCount.load()<<" in "<<reqBatches<<" messages; confirmations="<<confirmCount.load()<<" in "<<cfmBatches<<" messages"<<std::endl;
+    logger.Info()<<"Expiry: removed routes="<<expired<<"; avg lag="<<(expired>0?static_cast<double>(lagSum)/static_cast<double>(expired)/1000000.0:0.0)<<" ms; max lag="<<static_cast<double>(lagMax)/1000000.0<<" ms"<<std::endl;
+    {
+        auto line=logger.Info();
+        line<<"Lifetimes: one-off="<<oneOff<<", re-resolved="<<expired-oneOff<<";";
+        for(size_t i=0;i<TtlPolicy::histogramSize;++i)
+        {
+            if(lifetimes[i]<1)
+                continue;
+            if(i<TtlPolicy::histogramSize-1)
+                line<<" <"<<TtlPolicy::HistogramLimit(i)/60<<"m="<<lifetimes[i];
+            else
+                line<<" >="<<TtlPolicy::HistogramLimit(i-1)/60<<"m="<<lifetimes[i];
+        }
+        line<<std::endl;
+    }
+    if(shardRouteLimit>0)
+        logger.Info()<<"Route limit: "<<shardRouteLimit<<" per shard, "<<(evictLFU?"LFU":"LRU")<<" eviction; evicted="<<evicted<<"; refused="<<refused<<"; fill alerts="<<alerts<<std::endl;
+    logger.Info()<<"Paths: ipv4="<<(activePath4<0?std::string("none"):paths[static_cast<size_t>(activePath4)].ifname)<<"; ipv6="<<(activePath6<0?std::string("none"):paths[static_cast<size_t>(activePath6)].ifname)<<"; path switches="<<failoverCount<<"; last switch time="<<static_cast<double>(lastFailoverUs)/1000.0<<" ms"<<std::endl;
+    logger.Info()<<"Pacing: "<<pacer<<std::endl;
+    {
+        static const char* const laneNames[LANE_COUNT]={"new","retry","refresh","reinstall"};
+        auto line=logger.Info();
+        line<<"Lanes:";
+        for(size_t l=0;l<LANE_COUNT;++l)
+        {
+            auto lane=static_cast<RequestLane>(l);
+            size_t queued=0;
+            uint64_t served=0, shed=0, waitSum=0, waitMax=0;
+            for(auto &shard : shards)
+            {
+                const std::lock_guard<std::mutex> shardLock(shard->lock);
+                queued+=shard->lanes.Size(lane);
+                served+=shard->lanes.Served(lane);
+                shed+=shard->lanes.Shed(lane);
+                waitSum+=shard->lanes.WaitSum(lane);
+                waitMax=std::max(waitMax,shard->lanes.WaitMax(lane));
+            }
+            line<<" "<<laneNames[l]<<" queued="<<queued<<", served="<<served<<", shed="<<shed;
+            line<<", avg wait="<<(served>0?static_cast<double>(waitSum)/static_cast<double>(served)/1000000.0:0.0)<<" ms, max wait="<<static_cast<double>(waitMax)/1000000.0<<" ms;";
+        }
+        line<<std::endl;
+    }
+    logger.Info()<<"Rejected routes: held="<<held<<"; backoff retries="<<backoffs<<"; waiting for interface change="<<netDevWaits<<"; given up="<<giveUps<<std::endl;
+    {
+        const std::lock_guard<std::mutex> errGuard(errLock);
+        if(!nlErrors.empty())
+        {
+            auto line=logger.Info();
+            line<<"Netlink errors:";
+            for(auto const &el : nlErrors)
+                line<<" "<<strerror(el.first)<<" (errno "<<el.first<<")="<<el.second<<";";
+            line<<std::endl;
+        }
+    }
+    if(fibFilter)
+    {
+        const std::lock_guard<std::mutex> fibGuard(fibLock);
+        logger.Info()<<"FIB filter: tracked routes="<<fibRoutes.Size()<<"; skipped route-requests="<<fibSkipped<<std::endl;
+    }
 }
 
 bool RoutingManager::ReadyForMessage(const MsgType msgType)
 {
-    return (!shutdownPending.load())&&(msgType==MSG_NETDEV_UPDATE||msgType==MSG_ROUTE_REQUEST||msgType==MSG_ROUTE_ADDED||msgType==MSG_ROUTE_REMOVED);
+    return (!shutdownPending.load())&&(msgType==MSG_NETDEV_UPDATE||msgType==MSG_ROUTE_REQUEST||msgType==MSG_ROUTE_CONFIRM||msgType==MSG_ROUTES_RESYNC||(fibFilter&&msgType==MSG_FIB_UPDATE));
 }
 
 //this logic executed from thread emitting the messages, and must be internally locked
@@ -413,28 +1883,32 @@ void RoutingManager::OnMessage(const IMessage& message)
 {
     if(message.msgType==MSG_NETDEV_UPDATE)
     {
-        ProcessNetDevUpdate(static_cast<const INetDevUpdateMessage&>(message).config);
+        auto &devMsg=static_cast<const INetDevUpdateMessage&>(message);
+        ProcessNetDevUpdate(devMsg.ifname,devMsg.config,devMsg.timestamp);
         return;
     }
 
     if(message.msgType==MSG_ROUTE_REQUEST)
     {
-        auto reqMsg=static_cast<const IRouteRequestMessage&>(message);
-        InsertRoute(reqMsg.ip,reqMsg.ttl);
+        InsertRoutes(static_cast<const IRouteRequestMessage&>(message).requests);
+        return;
+    }
+
+    if(message.msgType==MSG_ROUTE_CONFIRM)
+    {
+        ConfirmRoutes(static_cast<const IRouteConfirmMessage&>(message).confirmations);
         return;
     }
 
-    if(message.msgType==MSG_ROUTE_ADDED)
+    if(message.msgType==MSG_ROUTES_RESYNC)
     {
-        auto addMsg=static_cast<const IRouteAddedMessage&>(message);
-        ConfirmRouteAdd(addMsg.ip);
+        ReconcileRoutes(static_cast<const IRoutesResyncMessage&>(message).ifname);
         return;
     }
 
-    if(message.msgType==MSG_ROUTE_REMOVED)
+    if(message.msgType==MSG_FIB_UPDATE)
     {
-        auto rmMsg=static_cast<const IRouteRemovedMessage&>(message);
-        ConfirmRouteDel(rmMsg.ip);
+        ProcessFibUpdate(static_cast<const IFibUpdateMessage&>(message));
         return;
     }
 }
@@ -3,60 +3,225 @@
 
 #include "ILogger.h"
 #include "IPAddress.h"
+#include "IPNetwork.h"
 #include "InterfaceConfig.h"
-#include "ImmutableStorage.h"
+#include "EgressPath.h"
+#include "RouteMetrics.h"
+#include "RoutePacer.h"
+#include "RequestLanes.h"
+#include "TtlPolicy.h"
+#include "LPMTable.h"
 #include "IMessageSubscriber.h"
 #include "WorkerBase.h"
+#include "IReactorHandler.h"
+#include "IRouteState.h"
+#include "Reactor.h"
+
+#include <linux/netlink.h>
 
 #include <mutex>
+#include <memory>
 #include <atomic>
+#include <random>
 #include <ctime>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
+#include <set>
+#include <vector>
+#include <string>
 
-class RoutingManager : public IMessageSubscriber, public WorkerBase
+class RoutingManager : public IMessageSubscriber, public WorkerBase, public IReactorHandler, public IRouteState
 {
     private:
+        //route from the main routing table, that is not managed by this program
+        struct FibRoute
+        {
+            const unsigned int ifIdx;
+            const IPAddress gateway;
+            const int metric;
+        };
+        typedef std::map<int,FibRoute> FibRouteSet; //all routes of the same prefix by metric, first one is used by kernel
+
+        //active route record, expiration time may be refreshed without opLock via activeIndex
+        struct ActiveRoute
+        {
+            ActiveRoute(const uint64_t _expiration, const uint64_t _added):expiration(_expiration),expireMark(_expiration),added(_added),lastRequest(_added),avgInterval(0),requests(1){}
+            std::atomic<uint64_t> expiration; //0 - route is removed and must not be refreshed anymore
+            uint64_t expireMark; //time of the only valid expire mark in pendingExpires, accessed only with shard lock
+            const uint64_t added; //time of route activation
+            std::atomic<uint64_t> lastRequest; //time of the last request for this route, used to track re-resolution intervals
+            std::atomic<uint32_t> avgInterval; //moving average of re-resolution intervals in seconds, 0 - never re-resolved
+            std::atomic<uint32_t> requests; //count of requests for this route, used by LFU eviction
+        };
+        typedef std::unordered_map<IPNetwork,std::shared_ptr<ActiveRoute>> ActiveRouteMap;
+
+        //pending route rejected by kernel, it is not retried until the hold is over
+        struct RetryHold
+        {
+            uint64_t notBefore; //monotonic ns, UINT64_MAX - wait for the next interface state change
+            int rejects; //count of rejections, used for exponential backoff
+        };
+
+        //part of the route state, routes are distributed between shards by destination hash.
+        //every shard has its own lock and background worker, all fields must be accessed only using shard lock
+        struct Shard
+        {
+            std::mutex lock;
+            std::unordered_map<IPNetwork,uint64_t> pendingInserts; //pending (new and failed) routes
+            std::unordered_map<IPNetwork,int32_t> pendingRetries; //tries counter for pending routes
+            std::unordered_map<IPNetwork,RetryHold> retryHolds; //pending routes rejected by kernel
+            RequestLanes lanes; //route requests and re-installs waiting to be served, drained at paced rate
+            std::unordered_map<uint32_t,IPNetwork> ackWaits; //re-installed routes by netlink sequence number, confirmed by kernel ACK
+            ActiveRouteMap activeRoutes; //confirmed active routes
+            bool activeIndexDirty=false; //activeRoutes was modified after activeIndex snapshot was published
+            std::multimap<uint64_t,IPNetwork> pendingExpires; //routes sorted by expiration time, used by background management worker to decide what route to remove.
+                                                              //marks are not added on refresh, but rescheduled when reached
+            std::shared_ptr<const ActiveRouteMap> activeIndex; //read-only snapshot of activeRoutes, accessed without lock using std::atomic_load/atomic_store
+            int timer=-1; //timerfd, armed for the nearest deadline, shard worker sleeps on it
+            uint64_t armedDeadline=UINT64_MAX; //deadline currently set for the timer, monotonic ns
+            uint64_t nextRetry=UINT64_MAX; //time of the next pending inserts processing, monotonic ns
+            uint64_t nextPace=UINT64_MAX; //time when lanes may be drained further, monotonic ns
+            std::minstd_rand jitter; //random source for spreading expiry deadlines
+            uint64_t expiredCount=0; //count of routes removed by expiration
+            uint64_t expiryLagSum=0; //total delay of removal after expiration time, ns
+            uint64_t expiryLagMax=0; //maximum delay of removal after expiration time, ns
+            uint64_t rejectBackoffs=0; //count of rejected routes by applied retry policy
+            uint64_t rejectNetDevWaits=0;
+            uint64_t rejectGiveUps=0;
+            uint64_t expiredOneOff=0; //count of expired routes that were never re-resolved
+            uint64_t lifetimes[TtlPolicy::histogramSize]={}; //histogram of expired routes lifetime
+            uint64_t evictedCount=0; //count of active routes evicted to make room for new ones
+            uint64_t refusedCount=0; //count of new routes refused because route limit is reached and nothing may be evicted
+            uint64_t alertCount=0; //count of route table fill alerts
+            bool fillAlert=false; //route table fill is above alert level, the alert is logged once per crossing
+        };
+
+        //paths selected for generated routes, replaced as a whole when interface state changes
+        struct PathState
+        {
+            int active4; //index of path currently used for ipv4 routes, -1 if no path available
+            int active6; //index of path currently used for ipv6 routes, -1 if no path available
+            std::vector<bool> isPtP;
+        };
+
         //constants and thread-safe stuff
         ILogger &logger;
-        const std::string ifname;
-        const IPAddress gateway4;
-        const IPAddress gateway6;
-        const unsigned int extraTTL;
-        const int mgIntervalSec;
-        const int mgPercent;
+        const std::vector<EgressPath> paths; //interfaces and gateways for generated routes, ordered by preference
+        const TtlPolicy ttlPolicy; //lifetime of requested routes
+        const int mgIntervalSec; //interval between retries of pending route inserts
+        const int mgBudgetMs; //maximum time spent removing expired routes at once
         const int metric; //must be int, according to rtnetlink.7
         const int ksMetric; //must be int, according to rtnetlink.7
         const int addRetryCount; //TODO: make this value configurable
-        //varous locking stuff and cross-thread counters
+        const int prefixLen4; //prefix length of routes generated from ipv4 answers
+        const int prefixLen6; //prefix length of routes generated from ipv6 answers
+        const std::set<IPNetwork> staticRoutes; //permanent routes, installed on startup and never expire
+        const bool fibFilter; //skip routes already covered by existing routes via the same interface and gateway
+        const uint32_t nhID; //id of kernel nexthop group for ipv4 routes, nhID+1 is used for ipv6, nhID+2+2*i and nhID+3+2*i for their members on path i. 0 - do not use nexthop objects
+        const RouteMetrics routeMetrics; //kernel metrics (initcwnd, mtu, etc) attached to every generated non-blackhole route
+        const size_t shardCount;
+        const size_t shardRouteLimit; //maximum routes (active and pending) in single shard, 0 - not limited
+        const bool evictLFU; //evict least frequently requested routes instead of least recently requested ones
+        const size_t alertLevel; //count of routes in single shard that triggers fill alert
+        const std::string snapshotFile; //graceful restart: route state is saved here on shutdown and restored on startup, empty - disabled
+        RoutePacer pacer; //rate limit for bulk re-installs of pending routes, shared by all shards
+        //varous locking stuff and cross-thread counters.
+        //lock order: opLock -> shard lock -> fibLock, errLock is never held together with other locks
         std::mutex opLock;
+        std::mutex fibLock;
+        std::mutex errLock;
         std::atomic<bool> shutdownPending;
+        std::atomic<bool> started;
         std::atomic<uint64_t> curTime;
-        //all other fields must be accesed only using opLock mutex
-        bool started=false;
-        int sock;
-        ImmutableStorage<InterfaceConfig> ifCfg;
-        //containters for storing routes at various states
-        std::unordered_map<IPAddress,uint64_t> pendingInserts; //pending (new and failed) routes
-        std::unordered_map<IPAddress,int32_t> pendingRetries; //tries counter for pending routes
-        std::unordered_map<IPAddress,uint64_t> activeRoutes; //confirmed active routes
-        std::multimap<uint64_t,IPAddress> pendingExpires; //routes sorted by expiration time, used by background management worker to decide what route to remove
-        //service methods that will use opLock internally
-        void ManageRoutes();
-        void InsertRoute(const IPAddress &dest, unsigned int ttl);
-        void ConfirmRouteAdd(const IPAddress &dest);
-        void ConfirmRouteDel(const IPAddress &dest);
-        void ProcessNetDevUpdate(const InterfaceConfig &newConfig);
-        //internal service methods that is not using opLock.
-        uint64_t _UpdateCurTime();
-        void _InvalidateActiveRoutes(const bool ipv4, const bool ipv6);
-        void _ProcessPendingInserts();
-        void _FinalizeRouteInsert(const IPAddress &dest);
-        void _FinalizeRouteDelete(const IPAddress &dest);
-        void _ProcessRoute(const IPAddress &ip, const bool blackhole, const bool isAddRequest);
-        void _ProcessStaleRoutes();
+        std::atomic<uint64_t> fastRefreshCount; //count of expiration time updates performed without locks
+        std::atomic<uint64_t> requestBatches; //count of route request messages and requests carried by them
+        std::atomic<uint64_t> requestCount;
+        std::atomic<uint64_t> confirmBatches; //count of route confirmation messages and confirmations carried by them
+        std::atomic<uint64_t> confirmCount;
+        std::atomic<uint32_t> ackSeq; //source of sequence numbers for re-installs confirmed by ACK
+        std::unique_ptr<std::atomic<uint64_t>[]> removalGens; //route removal counters by destination hash, used to invalidate request deduplication
+        std::atomic<uint64_t> fibRemovalGen; //count of removed FIB routes, any of them may be covering route for skipped requests
+        std::shared_ptr<const PathState> pathState; //must be accessed only with std::atomic_load/atomic_store
+        std::vector<std::unique_ptr<Shard>> shards;
+        int sock; //netlink socket, opened on startup and used concurrently by all shards
+        Reactor *reactor=nullptr; //reactor mode: shard timers and netlink socket are served by reactor instead of worker threads
+        //fields must be accesed only using opLock mutex
+        std::vector<InterfaceConfigPtr> pathCfg; //interface config snapshot for every path
+        int activePath4=-1; //index of path currently used for ipv4 routes, -1 if no path available
+        int activePath6=-1; //index of path currently used for ipv6 routes, -1 if no path available
+        std::vector<unsigned char> nlBatch; //buffer for batched netlink messages
+        uint64_t failoverCount=0; //count of path switches between interfaces
+        uint64_t lastFailoverUs=0; //time from link event to the last route reprogrammed for the last path switch
+        std::unordered_map<IPNetwork,unsigned int> restoredPaths; //interface index of active routes restored from snapshot, checked when the first path is selected
+        //fields must be accesed only using fibLock mutex
+        LPMTable<FibRouteSet> fibRoutes; //routes from the main table not managed by us, used to detect redundant routes
+        uint64_t fibSkipped=0; //count of route-requests skipped because of covering route
+        //fields must be accesed only using errLock mutex
+        std::map<int,uint64_t> nlErrors; //count of netlink error replies by errno
+        //service methods that will use opLock, shard lock or fibLock internally
+        void ManageRoutes(Shard &shard);
+        void InsertRoutes(const std::vector<RouteRequest> &requests);
+        void ConfirmRoutes(const std::vector<RouteConfirmation> &confirmations);
+        void ReconcileRoutes(const std::string &ifname);
+        void ProcessNetDevUpdate(const std::string &ifname, const InterfaceConfigPtr &newConfig, const uint64_t eventTime);
+        void ProcessFibUpdate(const IFibUpdateMessage &message);
+        bool FindCoveringRoute(const IPNetwork &dest);
+        void ShardWorker(const size_t shardIdx);
+        bool Open();
+        bool Close();
+        void ProcessNetlinkReplies();
+        void ProcessNetlinkError(const nlmsghdr *nh);
+        void ProcessNetlinkAck(const uint32_t seq, const bool isError);
+        bool DumpOwnRoutes(std::unordered_map<IPNetwork,unsigned int> &unicast, std::unordered_set<IPNetwork> &blackholes);
+        //service methods that is not using locks at all, may be called from any thread
+        bool RefreshActiveRoute(Shard &shard, const IPNetwork &dest, const unsigned int ttl, const uint64_t now);
+        uint64_t RequestExpiration(ActiveRoute &route, const unsigned int ttl, const uint64_t now);
+        size_t ShardIndex(const IPNetwork &dest) const;
+        void BumpRemovalGeneration(const IPNetwork &dest);
+        Shard& GetShard(const IPNetwork &dest);
+        int ActivePath(const bool isV6) const;
+        uint64_t UpdateCurTime();
+        void ProcessRoute(const IPNetwork &dest, const bool blackhole, const bool isAddRequest, std::vector<unsigned char> *batch=nullptr, const uint32_t seq=0); //append to the batch instead of sending, nlBatch requires opLock. ACK is requested for non-zero seq
+        void SendBatch(std::vector<unsigned char> &batch, const size_t routes=0); //routes count is used to calibrate pacer
+        //internal service methods that must be called with shard lock held
+        void _RemoveActiveRoute(Shard &shard, ActiveRouteMap::iterator it);
+        void _PublishActiveIndex(Shard &shard);
+        void _InvalidateActiveRoutes(Shard &shard, const bool ipv4, const bool ipv6);
+        bool _InsertRoute(Shard &shard, const IPNetwork &dest, const uint64_t expirationTime, std::vector<unsigned char> &batch); //returns true if route was pushed
+        void _ConfirmRouteAdd(Shard &shard, const IPNetwork &dest, const std::string &ifname);
+        void _ConfirmRouteDel(Shard &shard, const IPNetwork &dest, const std::string &ifname);
+        void _ProcessPendingInserts(Shard &shard);
+        void _DrainLanes(Shard &shard, const uint64_t now);
+        void _FinalizeRouteInsert(Shard &shard, const IPNetwork &dest);
+        size_t _EvictRoutes(Shard &shard, std::vector<unsigned char> &batch); //returns count of evicted routes
+        void _CheckRouteLimit(Shard &shard);
+        void _FinalizeRouteDelete(Shard &shard, const IPNetwork &dest);
+        void _RejectRouteInsert(Shard &shard, const IPNetwork &dest, const int error, const std::string &reason);
+        bool _ProcessStaleRoutes(Shard &shard, const uint64_t now);
+        void _ScheduleRetry(Shard &shard, const uint64_t now);
+        void _ArmTimer(Shard &shard, const uint64_t deadline, const bool force);
+        uint64_t _NextDeadline(Shard &shard);
+        //internal service methods that must be called with opLock held
+        int _FindPath(const std::string &ifname) const;
+        int _SelectPath(const bool isV6) const;
+        void _PublishPathState();
+        void _UpdateActivePath(const bool isV6, const int prevPath, const uint64_t eventTime);
+        void _MigrateActiveRoutes(const bool isV6, const uint64_t eventTime, const bool groupLost);
+        bool _ProcessNexthop(const bool isV6);
+        void _SaveSnapshot();
+        void _RestoreSnapshot();
+        void _CheckRestoredPaths(const bool isV6);
     public:
-        RoutingManager(ILogger &logger, const std::string &ifname, const IPAddress &gateway4, const IPAddress &gateway6, const unsigned int extraTTL, const int mgIntervalSec, const int mgPercent, const int metric, const int ksMetric, const int addRetryCount);
+        RoutingManager(ILogger &logger, const std::vector<EgressPath> &paths, const TtlPolicy &ttlPolicy, const int mgIntervalSec, const int mgBudgetMs, const int metric, const int ksMetric, const int addRetryCount, const int prefixLen4, const int prefixLen6, const std::set<IPNetwork> &staticRoutes, const bool fibFilter, const uint32_t nhID, const RouteMetrics &routeMetrics, const int shardCount, const int paceRate, const int paceBurst, const int paceShare, const std::vector<int> &laneWeights, const int laneLimit, const int maxRoutes, const bool evictLFU, const int alertPct, const std::string &snapshotFile);
+        void LogStats();
+        //reactor mode, used instead of Startup/Shutdown
+        bool Attach(Reactor &reactor);
+        void Detach();
+        //IReactorHandler
+        void OnReactorEvent(const int fd, const uint32_t events) final;
+        //IRouteState
+        uint64_t RemovalGeneration(const IPAddress &ip) const final;
         //WorkerBase
         void Worker() final;
         void OnShutdown() final;
@@ -1,14 +1,15 @@
 #include "StateSaver.h"
 #include "RouteInfo.pb.h"
 
+#include <algorithm>
 #include <chrono>
-#include <thread>
+#include <climits>
+#include <poll.h>
 
-StateSaver::StateSaver(ILogger &_logger, const std::string &_filename, const int _saveInterval, const int _sleepMS):
+StateSaver::StateSaver(ILogger &_logger, const std::string &_filename, const int _saveInterval):
     logger(_logger),
     filename(_filename),
-    saveInterval(_saveInterval),
-    sleepMS(_sleepMS)
+    saveInterval(_saveInterval)
 {
     shutdownRequested.store(false);
     state=0;
@@ -41,10 +42,23 @@ void StateSaver::SaveRoutes(int)
 void StateSaver::Worker()
 {
     logger.Info()<<"Starting-up state saver, target file: "<<filename<<std::endl;
+    auto nextSave=std::chrono::steady_clock::now()+std::chrono::seconds(saveInterval);
     while(!shutdownRequested.load())
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(sleepMS));
+        //sleep until next save deadline, or until shutdown request
+        auto left=std::chrono::duration_cast<std::chrono::milliseconds>(nextSave-std::chrono::steady_clock::now()).count();
+        if(left>0)
+        {
+            pollfd wFd={GetWakeupFd(),POLLIN,0};
+            if(poll(&wFd,1,static_cast<int>(std::min(left,static_cast<decltype(left)>(INT_MAX))))!=0)
+            {
+                if((wFd.revents&POLLIN)!=0&&!shutdownRequested.load())
+                    ClearWakeup();
+                continue;
+            }
+        }
         SaveRoutes(1);
+        nextSave=std::chrono::steady_clock::now()+std::chrono::seconds(saveInterval);
     }
     logger.Info()<<"Shuting down state saver and flusing state-file"<<std::endl;
 }
@@ -4,7 +4,7 @@
 #include "ILogger.h"
 #include "IMessageSubscriber.h"
 #include "WorkerBase.h"
-#include "IPAddress.h"
+#include "IPNetwork.h"
 
 #include <atomic>
 #include <mutex>
@@ -17,15 +17,14 @@ class StateSaver : public IMessageSubscriber, public WorkerBase
     private:
         ILogger &logger;
         const std::string filename;
-        const int saveInterval;
-        const int sleepMS;
+        const int saveInterval; //seconds
         std::atomic<bool> shutdownRequested;
         std::mutex opLock;
         int state;
-        std::unordered_map<IPAddress,std::pair<uint64_t,bool>> routes;
+        std::unordered_map<IPNetwork,std::pair<uint64_t,bool>> routes;
         void SaveRoutes(int routeSaveCount);
     public:
-        StateSaver(ILogger &logger, const std::string &filename, const int saveInterval, const int sleepMS);
+        StateSaver(ILogger &logger, const std::string &filename, const int saveInterval);
         //WorkerBase
         void Worker() final;
         void OnShutdown() final;
@@ -0,0 +1,67 @@
+#include "TtlPolicy.h"
+
+#include <algorithm>
+
+//re-resolved route is kept for this count of its average re-resolution intervals
+#define TTL_HOLD_INTERVALS 3
+//weight of the new interval in the moving average is 1/TTL_INTERVAL_SMOOTHING
+#define TTL_INTERVAL_SMOOTHING 4
+
+TtlPolicy::TtlPolicy(const unsigned int _extraTTL, const unsigned int _minLifetime, const unsigned int _maxLifetime, const unsigned int _oneOffShare):
+    extraTTL(_extraTTL),
+    minLifetime(_minLifetime),
+    maxLifetime(_maxLifetime),
+    oneOffShare(std::min(_oneOffShare,100u))
+{
+}
+
+uint64_t TtlPolicy::Lifetime(const unsigned int ttl, const uint32_t avgInterval) const
+{
+    uint64_t extra=extraTTL;
+    if(IsAdaptive())
+        extra=avgInterval<1?extra*oneOffShare/100:std::max(extra,static_cast<uint64_t>(avgInterval)*TTL_HOLD_INTERVALS);
+    auto lifetime=static_cast<uint64_t>(ttl)+extra;
+    if(lifetime<minLifetime)
+        lifetime=minLifetime;
+    if(maxLifetime>0&&lifetime>maxLifetime)
+        lifetime=maxLifetime;
+    return lifetime;
+}
+
+uint32_t TtlPolicy::UpdateInterval(const uint32_t avgInterval, const uint64_t interval) const
+{
+    auto value=static_cast<int64_t>(std::min(interval,static_cast<uint64_t>(UINT32_MAX)));
+    if(avgInterval<1)
+        return static_cast<uint32_t>(value);
+    auto avg=static_cast<int64_t>(avgInterval);
+    avg+=(value-avg)/TTL_INTERVAL_SMOOTHING;
+    return static_cast<uint32_t>(std::max(avg,static_cast<int64_t>(1)));
+}
+
+size_t TtlPolicy::HistogramBucket(const uint64_t lifetime)
+{
+    size_t bucket=0;
+    while(bucket<histogramSize-1&&lifetime>=HistogramLimit(bucket))
+        bucket++;
+    return bucket;
+}
+
+uint64_t TtlPolicy::HistogramLimit(const size_t bucket)
+{
+    return bucket<histogramSize-1?60ULL<<bucket:UINT64_MAX;
+}
+
+std::ostream& operator<<(std::ostream& stream, const TtlPolicy& target)
+{
+    stream<<"extra ttl: "<<target.extraTTL<<"; lifetime limits: "<<target.minLifetime<<"-";
+    if(target.maxLifetime>0)
+        stream<<target.maxLifetime;
+    else
+        stream<<"unlimited";
+    stream<<"; adaptive ttl: ";
+    if(target.IsAdaptive())
+        stream<<target.oneOffShare<<"% of extra ttl for one-off routes, "<<TTL_HOLD_INTERVALS<<" re-resolution intervals for recurring ones";
+    else
+        stream<<"disabled";
+    return stream;
+}
@@ -0,0 +1,35 @@
+#ifndef TTLPOLICY_H
+#define TTLPOLICY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+
+//route lifetime policy: dns ttl plus extra ttl, clamped to configured limits.
+//in adaptive mode extra ttl depends on the route history: routes that were never re-resolved get only a share of it,
+//re-resolved ones are kept for at least few average re-resolution intervals, so a single late refresh does not remove them
+class TtlPolicy
+{
+    public:
+        static const size_t histogramSize=16; //lifetime histogram buckets: <1m, <2m, <4m, ..., the last one is unbounded
+
+        TtlPolicy(const unsigned int extraTTL, const unsigned int minLifetime, const unsigned int maxLifetime, const unsigned int oneOffShare);
+
+        //route lifetime in seconds for the dns ttl and average re-resolution interval of the route, 0 - never re-resolved
+        uint64_t Lifetime(const unsigned int ttl, const uint32_t avgInterval) const;
+        //moving average of re-resolution intervals updated with the new interval, seconds
+        uint32_t UpdateInterval(const uint32_t avgInterval, const uint64_t interval) const;
+        bool IsAdaptive() const { return oneOffShare>0; }
+
+        static size_t HistogramBucket(const uint64_t lifetime);
+        static uint64_t HistogramLimit(const size_t bucket); //upper bound of the bucket in seconds, UINT64_MAX for the last one
+
+        friend std::ostream& operator<<(std::ostream& stream, const TtlPolicy& target);
+
+        const unsigned int extraTTL;
+        const unsigned int minLifetime; //0 - not limited
+        const unsigned int maxLifetime; //0 - not limited
+        const unsigned int oneOffShare; //percent of extra ttl given to routes that were never re-resolved, 0 - adaptive mode disabled
+};
+
+#endif // TTLPOLICY_H
@@ -1,9 +1,43 @@
 #include "WorkerBase.h"
 
+#include <cstdint>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+WorkerBase::WorkerBase()
+{
+    wakeupFd=eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+}
+
+WorkerBase::~WorkerBase()
+{
+    if(wakeupFd!=-1)
+        close(wakeupFd);
+}
+
+int WorkerBase::GetWakeupFd() const
+{
+    return wakeupFd;
+}
+
+void WorkerBase::Wakeup()
+{
+    uint64_t value=1;
+    if(write(wakeupFd,&value,sizeof(value))!=sizeof(value))
+        return; //counter overflow, fd is readable anyway
+}
+
+void WorkerBase::ClearWakeup()
+{
+    uint64_t value=0;
+    if(read(wakeupFd,&value,sizeof(value))!=sizeof(value))
+        return; //nothing to clear
+}
+
 bool WorkerBase::Startup()
 {
     const std::lock_guard<std::mutex> lock(workerLock);
-    if(worker!=nullptr)
+    if(worker!=nullptr||wakeupFd==-1)
         return false;
     worker=new std::thread(&WorkerBase::Worker,this);
     return true;
@@ -15,6 +49,7 @@ bool WorkerBase::Shutdown()
     if(worker==nullptr)
         return false;
     OnShutdown();
+    Wakeup();
     worker->join();
     delete worker;
     worker=nullptr;
@@ -27,5 +62,6 @@ bool WorkerBase::RequestShutdown()
     if(worker==nullptr)
         return false;
     OnShutdown();
+    Wakeup();
     return true;
 }
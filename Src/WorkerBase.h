@@ -9,10 +9,16 @@ class WorkerBase
     private:
         std::mutex workerLock;
         std::thread* worker = nullptr;
+        int wakeupFd = -1;
     protected:
         virtual void Worker() = 0; // main worker's logic will run in a separate thread started by Startup method
         virtual void OnShutdown() = 0; // must be threadsafe and notify Worker to stop, will be called from Shutdown that itself may be called from any thread
+        int GetWakeupFd() const; // eventfd, that becomes readable after OnShutdown is invoked or Wakeup is called. Worker should poll it together with its own descriptors
+        void Wakeup(); // make wakeup fd readable, may be called from any thread
+        void ClearWakeup(); // reset wakeup fd after processing wakeup that is not shutdown request
     public:
+        WorkerBase();
+        virtual ~WorkerBase();
         virtual bool Startup(); //start separate thread from Worker method. Startup may be called from any thread
         virtual bool Shutdown(); //stop previously started thread, by invoking OnShutdown and awaiting Worker thread to complete
         virtual bool RequestShutdown(); //same as Shutdown, but only invoke OnShutdown and do not wait. Shutdown should be called next to collect thread
@@ -0,0 +1,42 @@
+#include "DomainFilter.h"
+
+#include <iostream>
+
+static int failures=0;
+
+static void Check(const bool condition, const std::string &message)
+{
+    if(condition)
+        return;
+    std::cerr<<"FAILED: "<<message<<std::endl;
+    failures++;
+}
+
+int main()
+{
+    //suffix rule written with leading dot
+    DomainFilter leading({{".example.com",1}});
+    Check(leading.IsValid(),"rule .example.com is valid");
+    Check(leading.Match("www.example.com")==1,".example.com matches www.example.com");
+    Check(leading.Match("example.com.")==1,".example.com matches example.com.");
+    Check(leading.Match("example.org")==DomainFilter::NoMatch,".example.com does not match example.org");
+    Check(leading.Match(".example.com")==1,"query .example.com matches");
+    Check(leading.Match("..")==DomainFilter::NoMatch,"query .. does not match");
+    Check(leading.Match(".")==DomainFilter::NoMatch,"query . does not match");
+
+    //rules made of dots only
+    DomainFilter dots({{"..",1}});
+    Check(!dots.IsValid(),"rule .. is invalid");
+    Check(dots.Match("..")==DomainFilter::NoMatch,"query .. does not match invalid rule");
+    DomainFilter root({{".",1},{"!.example.com",0}});
+    Check(root.IsValid(),"rule . is valid");
+    Check(root.Match(".")==1,"query . matches root rule");
+    Check(root.Match("..")==1,"query .. matches root rule");
+    Check(root.Match(".www.example.com")==DomainFilter::Exclude,"query .www.example.com is excluded");
+    Check(root.Match("a..example.com")==DomainFilter::Exclude,"query with empty label is excluded");
+
+    if(failures>0)
+        return 1;
+    std::cout<<"DomainFilter: all checks passed"<<std::endl;
+    return 0;
+}